@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include "admission.hpp"
+#include "drain_control.hpp"
+#include "frame_trace.hpp"
+#include "logging.hpp"
+#include "usage_accounting.hpp"
+
+//
+// Server state reported on the admin listener.
+//
+struct admin_status {
+    const drain_control& drain;
+    const std::atomic<bool>& modelLoaded;   // the model was loaded successfully at startup
+    std::function<int()> activeStreams;
+    std::function<admission_control::stats()> admission;    // stream listeners' accept queue
+    int maxStreams;                         // sum of the connection budgets of all listeners
+    unsigned cpuThreads;                    // threads that run NC work (io threads + io_uring loop)
+};
+
+//
+// cpu_monitor: measures the process's CPU use (user + system, all threads) once a second and
+// keeps the rate in cores, e.g. 1.5 = one and a half threads busy.
+//
+class cpu_monitor {
+public:
+    explicit cpu_monitor(boost::asio::io_context& io_context)
+        : timer_(io_context),
+          lastCpu_(process_cpu_seconds()),
+          lastWall_(std::chrono::steady_clock::now())
+    {
+        schedule();
+    }
+
+    double load() const {
+        return load_.load();
+    }
+
+private:
+    static double process_cpu_seconds() {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+    }
+
+    void schedule() {
+        timer_.expires_after(std::chrono::seconds(1));
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            double cpu = process_cpu_seconds();
+            auto wall = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(wall - lastWall_).count();
+            if (elapsed > 0) {
+                load_ = (cpu - lastCpu_) / elapsed;
+            }
+            lastCpu_ = cpu;
+            lastWall_ = wall;
+            schedule();
+        });
+    }
+
+    boost::asio::steady_timer timer_;
+    double lastCpu_;
+    std::chrono::steady_clock::time_point lastWall_;
+    std::atomic<double> load_{0.0};
+};
+
+//
+// Spare capacity as reported on GET /capacity and to a front end (see front_end.hpp).
+//
+struct capacity_estimate {
+    int active;
+    int freeSlots;
+    double load;            // cores in use, from cpu_monitor
+    double headroom;        // cores left of cpuThreads
+    int spare;              // further streams both the slots and the CPU headroom allow; 0 while draining
+
+    static capacity_estimate of(const admin_status& status, const cpu_monitor& cpu) {
+        capacity_estimate c{};
+        c.active = status.activeStreams();
+        c.freeSlots = std::max(0, status.maxStreams - c.active);
+        c.load = cpu.load();
+        c.headroom = std::max(0.0, static_cast<double>(status.cpuThreads) - c.load);
+        // Streams the CPU headroom allows at the current per-stream cost. With no stream open
+        // there is no cost estimate yet, so only the slots limit.
+        c.spare = c.freeSlots;
+        if (c.active > 0 && c.load > 0) {
+            c.spare = std::min(c.spare, static_cast<int>(c.headroom / (c.load / c.active)));
+        }
+        if (status.drain.draining()) {
+            c.spare = 0;
+        }
+        return c;
+    }
+};
+
+//
+// admin_session: answers one HTTP request and closes.
+//   GET /health    liveness: 200 while the process serves requests, with the drain state.
+//   GET /ready     readiness: 200 once the model is loaded and while not draining, 503 otherwise.
+//   GET /capacity  free connection slots, measured CPU load and headroom, and the number of
+//                  further streams both allow, for weighted load balancing; also the accept
+//                  queue depth and its admission counters.
+//   GET /usage     per-tenant usage since start (see usage_accounting.hpp): streams, frames and
+//                  the wall and CPU time spent processing them and in their I/O handlers.
+//   POST /trace    writes the sampled frame trace (see frame_trace.hpp) to its file in the
+//                  background and answers 202 with the path and span count.
+// Probes never create an NC session or take a connection slot, and a connection that stays
+// silent is closed after request_timeout.
+//
+class admin_session : public std::enable_shared_from_this<admin_session> {
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    // A probe gets this long to send its request and read the answer.
+    static constexpr std::chrono::seconds request_timeout{5};
+
+    // The socket must be on its own strand: the deadline closes it from its own handler.
+    admin_session(tcp::socket socket, const admin_status& status, const cpu_monitor& cpu)
+        : socket_(std::move(socket)),
+          deadline_(socket_.get_executor(), request_timeout),
+          status_(status),
+          cpu_(cpu)
+    {
+    }
+
+    void start() {
+        auto self(shared_from_this());
+        deadline_.async_wait([this, self](boost::system::error_code ec) {
+            if (!ec) {
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+            }
+        });
+        boost::beast::http::async_read(socket_, buffer_, request_,
+            [this, self](boost::beast::error_code ec, std::size_t) {
+                if (ec) {
+                    deadline_.cancel();
+                    return;
+                }
+                respond();
+            }
+        );
+    }
+
+private:
+    static const char* json_bool(bool value) {
+        return value ? "true" : "false";
+    }
+
+    static std::string json_number(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", value);
+        return text;
+    }
+
+    std::string capacity_body() const {
+        auto capacity = capacity_estimate::of(status_, cpu_);
+        auto queue = status_.admission();
+        return "{\"max_streams\":" + std::to_string(status_.maxStreams) +
+               ",\"active_streams\":" + std::to_string(capacity.active) +
+               ",\"free_slots\":" + std::to_string(capacity.freeSlots) +
+               ",\"cpu_threads\":" + std::to_string(status_.cpuThreads) +
+               ",\"cpu_load\":" + json_number(capacity.load) +
+               ",\"cpu_headroom\":" + json_number(capacity.headroom) +
+               ",\"spare_streams\":" + std::to_string(capacity.spare) +
+               ",\"queue_waiting\":" + std::to_string(queue.waiting) +
+               ",\"queued_total\":" + std::to_string(queue.queued) +
+               ",\"rejected_total\":" + std::to_string(queue.rejected) +
+               ",\"queue_timeouts_total\":" + std::to_string(queue.timedOut) + "}\n";
+    }
+
+    void trace_response(boost::beast::http::status& code, std::string& body) const {
+        namespace http = boost::beast::http;
+        if (request_.method() != http::verb::post) {
+            code = http::status::method_not_allowed;
+            body = "{\"error\":\"method not allowed\"}\n";
+            return;
+        }
+        long spans = tracer().dump();
+        if (spans >= 0) {
+            code = http::status::accepted;
+            body = "{\"trace\":\"" + tracer().path() + "\",\"spans\":" + std::to_string(spans) + "}\n";
+        } else {
+            code = http::status::conflict;
+            body = tracer().enabled() ? "{\"error\":\"a trace dump is still being written\"}\n"
+                                      : "{\"error\":\"tracing is off (--trace-every)\"}\n";
+        }
+    }
+
+    void respond() {
+        namespace http = boost::beast::http;
+        bool draining = status_.drain.draining();
+        bool loaded = status_.modelLoaded.load();
+
+        http::status code = http::status::ok;
+        std::string body;
+        if (request_.target() == "/trace") {
+            trace_response(code, body);
+        } else if (request_.method() != http::verb::get) {
+            code = http::status::method_not_allowed;
+            body = "{\"error\":\"method not allowed\"}\n";
+        } else if (request_.target() == "/health") {
+            body = "{\"status\":\"ok\",\"draining\":" + std::string(json_bool(draining)) +
+                   ",\"active_streams\":" + std::to_string(status_.activeStreams()) + "}\n";
+        } else if (request_.target() == "/ready") {
+            bool ready = loaded && !draining;
+            code = ready ? http::status::ok : http::status::service_unavailable;
+            body = "{\"ready\":" + std::string(json_bool(ready)) + ",\"model_loaded\":" + json_bool(loaded) +
+                   ",\"draining\":" + json_bool(draining) + "}\n";
+        } else if (request_.target() == "/capacity") {
+            body = capacity_body();
+        } else if (request_.target() == "/usage") {
+            body = usage().json();
+        } else {
+            code = http::status::not_found;
+            body = "{\"error\":\"not found\"}\n";
+        }
+
+        response_.version(request_.version());
+        response_.result(code);
+        response_.set(http::field::content_type, "application/json");
+        response_.set(http::field::cache_control, "no-store");
+        response_.keep_alive(false);
+        response_.body() = std::move(body);
+        response_.prepare_payload();
+
+        auto self(shared_from_this());
+        http::async_write(socket_, response_,
+            [this, self](boost::beast::error_code, std::size_t) {
+                deadline_.cancel();
+                boost::system::error_code ignored;
+                socket_.shutdown(tcp::socket::shutdown_both, ignored);
+            }
+        );
+    }
+
+    tcp::socket socket_;
+    boost::asio::steady_timer deadline_;
+    const admin_status& status_;
+    const cpu_monitor& cpu_;
+    boost::beast::flat_buffer buffer_;
+    boost::beast::http::request<boost::beast::http::string_body> request_;
+    boost::beast::http::response<boost::beast::http::string_body> response_;
+};
+
+//
+// admin_server: HTTP listener for load balancers and orchestration. It keeps serving while the
+// server drains, so readiness turns to 503 as soon as draining starts.
+//
+class admin_server {
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    admin_server(boost::asio::io_context& io_context, unsigned short port, admin_status status)
+        : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
+          status_(std::move(status)),
+          cpu_(io_context)
+    {
+        log_info("Admin endpoint listening on " + acceptor_.local_endpoint().address().to_string() +
+                 ":" + std::to_string(acceptor_.local_endpoint().port()));
+        do_accept();
+    }
+
+private:
+    void do_accept() {
+        acceptor_.async_accept(boost::asio::make_strand(acceptor_.get_executor()),
+            [this](boost::system::error_code ec, tcp::socket socket) {
+                if (!ec) {
+                    std::make_shared<admin_session>(std::move(socket), status_, cpu_)->start();
+                } else if (ec != boost::asio::error::operation_aborted) {
+                    log_error("Admin accept error: " + ec.message());
+                }
+                if (acceptor_.is_open())
+                    do_accept();
+            }
+        );
+    }
+
+    tcp::acceptor acceptor_;
+    admin_status status_;
+    cpu_monitor cpu_;
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+
+#include "stream_message.hpp"
+
+// Sent in place of the attach acknowledgement to a shared-memory control connection turned
+// away because the server is full (or draining).
+static constexpr char busy_notice_byte = 'B';
+
+// The busy response of the stream transports: a stream_message control message holding this, so
+// a framed client reads it like any other control message and a plain PCM client finds these
+// bytes where it expected audio, then the close.
+static constexpr const char* busy_notice_text = "{\"event\":\"busy\"}";
+
+// Sends the busy response on a stream connection (TCP, Unix socket, io_uring or the front end's)
+// and shuts down its sending side; the caller closes it. The connection is fresh, so the message
+// fits its send buffer and nothing here waits. Audio the client sent while queued is discarded
+// first; closing with unread data would reset the connection and could drop the response.
+inline void send_busy_notice(int fd) {
+    static const std::string message = stream_message::control_message(busy_notice_text);
+    send(fd, message.data(), message.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    ::shutdown(fd, SHUT_WR);
+    std::array<char, 4096> discard;
+    while (recv(fd, discard.data(), discard.size(), MSG_DONTWAIT) > 0) {
+    }
+}
+
+template <typename Socket>
+inline void send_busy_notice(Socket& socket) {
+    send_busy_notice(socket.native_handle());
+    boost::system::error_code ignored;
+    socket.close(ignored);
+}
+
+//
+// admission_control: the connection slots shared by the stream listeners.
+//
+// A slot is reserved atomically at accept time, before the session exists, so concurrent accepts
+// can never overshoot the limit. When no slot is free, the connection waits in a bounded FIFO
+// until a session releases one (the slot passes straight to the oldest waiter) or until its wait
+// times out; short bursts are absorbed instead of rejected. Connections that find the queue full,
+// time out, or are still waiting when the server drains are refused, and the caller sends them
+// an explicit busy response.
+//
+class admission_control {
+public:
+    struct stats {
+        int active;
+        std::size_t waiting;
+        uint64_t admitted;
+        uint64_t queued;
+        uint64_t rejected;      // queue full or draining
+        uint64_t timedOut;      // waited the whole timeout without a slot
+    };
+
+    admission_control(boost::asio::io_context& io_context, int maxSlots, std::size_t maxQueue,
+                      std::chrono::milliseconds queueTimeout)
+        : io_context_(io_context),
+          maxSlots_(maxSlots),
+          maxQueue_(maxQueue),
+          queueTimeout_(queueTimeout)
+    {
+    }
+
+    // Reserves a slot and calls granted, now or (through the io_context) once a slot frees up.
+    // Calls refused instead when the connection cannot wait. The granted caller owns the slot and
+    // must release() it.
+    void admit(std::function<void()> granted, std::function<void()> refused) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!closed_ && active_.load() < maxSlots_) {
+            ++active_;
+            ++admitted_;
+            lock.unlock();
+            granted();
+            return;
+        }
+        if (closed_ || waiters_.size() >= maxQueue_) {
+            ++rejected_;
+            lock.unlock();
+            refused();
+            return;
+        }
+
+        uint64_t id = ++nextWaiter_;
+        auto timer = std::make_shared<boost::asio::steady_timer>(io_context_, queueTimeout_);
+        waiters_.push_back(waiter{id, std::move(granted), std::move(refused), timer});
+        ++queued_;
+        lock.unlock();
+
+        timer->async_wait([this, id](boost::system::error_code ec) {
+            if (!ec) {
+                expire(id);
+            }
+        });
+    }
+
+    // Returns a slot: the oldest waiter takes it over, otherwise it becomes free.
+    void release() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (waiters_.empty()) {
+            --active_;
+            return;
+        }
+        waiter next = std::move(waiters_.front());
+        waiters_.pop_front();
+        ++admitted_;
+        lock.unlock();
+        // Never start the next session from inside the releasing session's destructor.
+        boost::asio::post(io_context_, [next = std::move(next)]() {
+            next.timer->cancel();
+            next.granted();
+        });
+    }
+
+    // Refuses every waiting connection and all further admissions (drain / shutdown).
+    void close() {
+        std::list<waiter> refused;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            rejected_ += waiters_.size();
+            refused.swap(waiters_);
+        }
+        for (auto& w : refused) {
+            boost::asio::post(io_context_, [w = std::move(w)]() {
+                w.timer->cancel();
+                w.refused();
+            });
+        }
+    }
+
+    int active() const {
+        return active_.load();
+    }
+
+    stats get_stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats{active_.load(), waiters_.size(), admitted_, queued_, rejected_, timedOut_};
+    }
+
+private:
+    struct waiter {
+        uint64_t id;
+        std::function<void()> granted;
+        std::function<void()> refused;
+        std::shared_ptr<boost::asio::steady_timer> timer;
+    };
+
+    void expire(uint64_t id) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto it = waiters_.begin(); it != waiters_.end(); ++it) {
+            if (it->id == id) {
+                waiter w = std::move(*it);
+                waiters_.erase(it);
+                ++timedOut_;
+                lock.unlock();
+                w.refused();
+                return;
+            }
+        }
+    }
+
+    boost::asio::io_context& io_context_;
+    int maxSlots_;
+    std::size_t maxQueue_;
+    std::chrono::milliseconds queueTimeout_;
+    mutable std::mutex mutex_;      // guards the queue and the counters below
+    std::atomic<int> active_{0};    // reserved slots; written under mutex_, read anywhere
+    std::list<waiter> waiters_;
+    uint64_t nextWaiter_ = 0;
+    bool closed_ = false;
+    uint64_t admitted_ = 0;
+    uint64_t queued_ = 0;
+    uint64_t rejected_ = 0;
+    uint64_t timedOut_ = 0;
+};
+
+//
+// One slot reserved through admission_control::admit(), held by a session. The session releases
+// it in its destructor before logging, so the logged count is current; if the session constructor
+// throws, the slot is released on unwinding instead.
+//
+class admission_slot {
+public:
+    explicit admission_slot(admission_control& admission)
+        : admission_(admission)
+    {
+    }
+
+    ~admission_slot() {
+        release();
+    }
+
+    admission_slot(const admission_slot&) = delete;
+    admission_slot& operator=(const admission_slot&) = delete;
+
+    void release() {
+        if (!released_) {
+            released_ = true;
+            admission_.release();
+        }
+    }
+
+    int active() const {
+        return admission_.active();
+    }
+
+private:
+    admission_control& admission_;
+    bool released_ = false;
+};
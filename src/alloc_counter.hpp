@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+//
+// Heap allocation accounting for hot-path verification builds.
+//
+// Built with -DAPM_COUNT_ALLOCATIONS (cmake -D APM_ALLOC_CHECK=ON), this header replaces the
+// global operator new/delete with counting versions, and sessions log how many allocations the
+// process made while they were streaming. Without the flag everything compiles away. The
+// counter is process-wide, so the per-session figure is exact only while one stream is active.
+// Include it from one translation unit per executable (each target here is a single main.cpp).
+//
+#ifdef APM_COUNT_ALLOCATIONS
+
+// GCC pairs inlined new-expressions with the free() below and reports a false mismatch. The
+// warning is only silenced for the replacement operators themselves.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+inline std::atomic<uint64_t> heap_allocation_count{0};
+
+inline uint64_t heap_allocations() {
+    return heap_allocation_count.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#else
+
+inline uint64_t heap_allocations() {
+    return 0;
+}
+
+#endif
+
+//
+// Counts a stream's frames and the heap allocations made between the end of its warm-up and its
+// last frame. One-time allocations (handler memory, SDK state, the first log lines) fall inside
+// the warm-up; teardown (close logs, stats) comes after the last frame.
+//
+class hot_path_probe {
+public:
+    static constexpr uint64_t warmup_frames = 16;
+
+    void on_frame() {
+        last_ = heap_allocations();
+        if (++frames_ == warmup_frames) {
+            baseline_ = last_;
+        }
+    }
+
+    uint64_t steady_frames() const {
+        return frames_ > warmup_frames ? frames_ - warmup_frames : 0;
+    }
+
+    uint64_t steady_allocations() const {
+        return frames_ >= warmup_frames ? last_ - baseline_ : 0;
+    }
+
+private:
+    uint64_t frames_ = 0;
+    uint64_t baseline_ = 0;
+    uint64_t last_ = 0;
+};
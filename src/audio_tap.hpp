@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logging.hpp"
+
+//
+// Recording options; an empty directory disables tapping.
+//
+struct tap_config {
+    std::string directory;
+    unsigned every = 1;     // tap one of every N streams
+    bool wav = true;        // WAV files, or headerless little-endian PCM16
+};
+
+//
+// One output file of a tap. Samples collect in a large buffer that is written with a single
+// write() once full, so the disk sees few, large writes. For WAV, a header with zero sizes is
+// written first and patched with the final sizes on finish().
+//
+class tap_file {
+public:
+    static constexpr std::size_t buffer_bytes = 256 * 1024;
+
+    tap_file() = default;
+    tap_file(const tap_file&) = delete;
+    tap_file& operator=(const tap_file&) = delete;
+
+    ~tap_file() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    bool open(const std::string& path, bool wav, unsigned sampleRate) {
+        path_ = path;
+        wav_ = wav;
+        sampleRate_ = sampleRate;
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            log_error("Tap: cannot create " + path + ": " + std::strerror(errno));
+            return false;
+        }
+        buffer_.reserve(buffer_bytes);
+        if (wav_) {
+            append_header(0);
+        }
+        return true;
+    }
+
+    void append(const int16_t* samples, std::size_t count) {
+        auto bytes = reinterpret_cast<const char*>(samples);
+        buffer_.insert(buffer_.end(), bytes, bytes + count * sizeof(int16_t));
+        dataBytes_ += count * sizeof(int16_t);
+        if (buffer_.size() >= buffer_bytes) {
+            flush();
+        }
+    }
+
+    void finish() {
+        flush();
+        if (wav_ && fd_ >= 0) {
+            append_header(dataBytes_);
+            if (::pwrite(fd_, buffer_.data(), buffer_.size(), 0) != static_cast<ssize_t>(buffer_.size())) {
+                log_error("Tap: cannot finalize " + path_ + ": " + std::strerror(errno));
+            }
+            buffer_.clear();
+        }
+    }
+
+private:
+    static void put_le(std::vector<char>& out, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    // Canonical 44-byte header for mono PCM16.
+    void append_header(uint64_t dataBytes) {
+        auto data = static_cast<uint32_t>(std::min<uint64_t>(dataBytes, 0xffffffffu - 36));
+        buffer_.insert(buffer_.end(), {'R', 'I', 'F', 'F'});
+        put_le(buffer_, 36 + data, 4);
+        buffer_.insert(buffer_.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+        put_le(buffer_, 16, 4);
+        put_le(buffer_, 1, 2);                  // PCM
+        put_le(buffer_, 1, 2);                  // mono
+        put_le(buffer_, sampleRate_, 4);
+        put_le(buffer_, sampleRate_ * 2, 4);    // byte rate
+        put_le(buffer_, 2, 2);                  // block align
+        put_le(buffer_, 16, 2);                 // bits per sample
+        buffer_.insert(buffer_.end(), {'d', 'a', 't', 'a'});
+        put_le(buffer_, data, 4);
+    }
+
+    void flush() {
+        std::size_t offset = 0;
+        while (fd_ >= 0 && offset < buffer_.size()) {
+            ssize_t n = ::write(fd_, buffer_.data() + offset, buffer_.size() - offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                log_error("Tap: write to " + path_ + " failed: " + std::strerror(errno));
+                ::close(fd_);
+                fd_ = -1;
+                break;
+            }
+            offset += static_cast<std::size_t>(n);
+        }
+        buffer_.clear();
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    bool wav_ = true;
+    unsigned sampleRate_ = 0;
+    uint64_t dataBytes_ = 0;
+    std::vector<char> buffer_;
+};
+
+//
+// audio_tap: the recording of one stream, input and output side by side.
+//
+// The stream's processing path is the only producer: push() copies the frame pair into a
+// single-producer / single-consumer ring and returns, without locks or system calls. When the
+// ring is full (the writer thread has fallen behind) the pair is dropped and counted instead;
+// processing is never held up. The tap_writer thread is the only consumer.
+//
+class audio_tap {
+public:
+    static constexpr std::size_t queue_frames = 256;     // about 5 s of audio
+
+    explicit audio_tap(std::size_t frameSamples)
+        : frameSamples_(frameSamples),
+          slots_(queue_frames * 2 * frameSamples)
+    {
+    }
+
+    // Producer side.
+    void push(const int16_t* in, const int16_t* out) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= queue_frames) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        int16_t* slot = slots_.data() + (head % queue_frames) * 2 * frameSamples_;
+        std::memcpy(slot, in, frameSamples_ * sizeof(int16_t));
+        std::memcpy(slot + frameSamples_, out, frameSamples_ * sizeof(int16_t));
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Producer side: the stream ended; the writer finishes the files once the ring is empty.
+    void close() {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    uint64_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class tap_writer;
+
+    // Consumer side. Writes every queued pair; returns true once the stream has ended and
+    // everything it queued is on disk.
+    bool drain() {
+        bool closed = closed_.load(std::memory_order_acquire);
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        written_ += head - tail;
+        for (; tail != head; ++tail) {
+            const int16_t* slot = slots_.data() + (tail % queue_frames) * 2 * frameSamples_;
+            in_.append(slot, frameSamples_);
+            out_.append(slot + frameSamples_, frameSamples_);
+            tail_.store(tail + 1, std::memory_order_release);
+        }
+        if (closed) {
+            in_.finish();
+            out_.finish();
+        }
+        return closed;
+    }
+
+    std::size_t frameSamples_;
+    std::vector<int16_t> slots_;
+    alignas(64) std::atomic<uint64_t> head_{0};     // written by the producer
+    alignas(64) std::atomic<uint64_t> tail_{0};     // written by the consumer
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> closed_{false};
+    tap_file in_;
+    tap_file out_;
+    uint64_t written_ = 0;
+    std::string name_;
+};
+
+//
+// tap_writer: the background thread that moves tapped audio from the streams' rings to disk.
+// Streams are selected when they start (one of every tap_config::every). The thread wakes
+// every poll_interval, so producers never need to signal it.
+//
+// It must outlive every stream that may hold a tap; on destruction it writes out what is still
+// queued and finishes all files.
+//
+class tap_writer {
+public:
+    static constexpr std::chrono::milliseconds poll_interval{20};
+
+    explicit tap_writer(tap_config cfg)
+        : cfg_(std::move(cfg))
+    {
+        if (enabled()) {
+            log_info("Recording " + std::string(cfg_.every > 1 ? "one of every " + std::to_string(cfg_.every) + " streams" : "all streams") +
+                     " to " + cfg_.directory + (cfg_.wav ? " (WAV)" : " (raw PCM16)"));
+            thread_ = std::thread([this]() { run(); });
+        }
+    }
+
+    ~tap_writer() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        print_stats();
+    }
+
+    tap_writer(const tap_writer&) = delete;
+    tap_writer& operator=(const tap_writer&) = delete;
+
+    bool enabled() const {
+        return !cfg_.directory.empty();
+    }
+
+    // Returns a tap for a new stream, or nullptr when this stream is not recorded. Files are
+    // named <directory>/<unix time>-<sequence>-<label>-{in,out}.<wav|pcm>. Thread-safe.
+    std::shared_ptr<audio_tap> open(const std::string& label, unsigned sampleRate, std::size_t frameSamples) {
+        if (!enabled() || streams_.fetch_add(1) % std::max(cfg_.every, 1u) != 0) {
+            return nullptr;
+        }
+        std::string name = std::to_string(std::time(nullptr)) + "-" + std::to_string(++opened_) + "-" + sanitize(label);
+        std::string base = cfg_.directory + "/" + name;
+        const char* ext = cfg_.wav ? ".wav" : ".pcm";
+
+        auto tap = std::make_shared<audio_tap>(frameSamples);
+        tap->name_ = name;
+        if (!tap->in_.open(base + "-in" + ext, cfg_.wav, sampleRate) ||
+            !tap->out_.open(base + "-out" + ext, cfg_.wav, sampleRate)) {
+            return nullptr;
+        }
+        log_info("Tap: recording " + name);
+        std::lock_guard<std::mutex> lock(mutex_);
+        taps_.push_back(tap);
+        return tap;
+    }
+
+private:
+    static std::string sanitize(std::string label) {
+        for (char& c : label) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-') {
+                c = '_';
+            }
+        }
+        return label;
+    }
+
+    void run() {
+        std::vector<std::shared_ptr<audio_tap>> taps;
+        for (;;) {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait_for(lock, poll_interval, [this]() { return stopping_; });
+                stopping = stopping_;
+                taps = taps_;
+            }
+            for (auto& tap : taps) {
+                // At shutdown every remaining stream is finished, ended or not.
+                if (stopping) {
+                    tap->close();
+                }
+                if (tap->drain()) {
+                    finished(tap);
+                }
+            }
+            taps.clear();
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    void finished(const std::shared_ptr<audio_tap>& tap) {
+        uint64_t dropped = tap->dropped();
+        log_info("Tap: finished " + tap->name_ + " | Frames: " + std::to_string(tap->written_) +
+                 " | Dropped: " + std::to_string(dropped));
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++finished_;
+        framesWritten_ += tap->written_;
+        framesDropped_ += dropped;
+        taps_.erase(std::remove(taps_.begin(), taps_.end(), tap), taps_.end());
+    }
+
+    void print_stats() {
+        log_info("#--- Tap stats ---"
+            "\n# - Recordings: " + std::to_string(finished_) +
+            "\n# - Frames written: " + std::to_string(framesWritten_) +
+            "\n# - Frames dropped: " + std::to_string(framesDropped_)
+        );
+    }
+
+    tap_config cfg_;
+    std::atomic<uint64_t> streams_{0};
+    std::atomic<uint64_t> opened_{0};
+    std::mutex mutex_;      // guards taps_, stopping_ and the totals
+    std::condition_variable wake_;
+    std::vector<std::shared_ptr<audio_tap>> taps_;
+    bool stopping_ = false;
+    uint64_t finished_ = 0;
+    uint64_t framesWritten_ = 0;
+    uint64_t framesDropped_ = 0;
+    std::thread thread_;
+};
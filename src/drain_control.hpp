@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "logging.hpp"
+
+// In-band drain notice: a text message on WebSocket, a line on shared-memory control
+// connections and a control message on framed TCP and Unix-socket streams. Plain PCM streams
+// have no place for it and only see the close at the drain timeout.
+static constexpr const char* drain_notice_text = "{\"event\":\"drain\"}";
+
+//
+// A live stream (or a backend owning several) that is told when the server starts draining, so
+// it can ask its client to reconnect elsewhere, and when the drain timeout has passed, so it can
+// close. Both may be called from any thread; the implementation hops onto its own executor.
+//
+class drain_listener {
+public:
+    virtual void on_drain() = 0;
+    virtual void on_drain_timeout() = 0;
+
+protected:
+    ~drain_listener() = default;
+};
+
+//
+// drain_control: graceful shutdown without polling.
+//
+// Sessions join() when they start and leave() from their destructors; backends whose streams
+// are not drain_listeners (RTP, io_uring) call stream_closed() whenever one ends. begin() marks
+// the server as draining, notifies every listener and then re-checks the active count each time
+// a stream ends, so the done callback runs as soon as the last one is gone instead of on a timer
+// tick. At the deadline, the remaining listeners close their streams, which ends the drain the
+// same way; only streams still open after a further grace period are left to the io_context.
+//
+// It must outlive the io_context: such streams are destroyed with the io_context and leave() on
+// the way out.
+//
+class drain_control {
+public:
+    bool draining() const {
+        return draining_.load();
+    }
+
+    void join(drain_listener& listener) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners_.push_back(&listener);
+    }
+
+    void leave(drain_listener& listener) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), &listener), listeners_.end());
+        }
+        stream_closed();
+    }
+
+    // A stream ended; while draining, re-check whether it was the last one. Thread-safe.
+    void stream_closed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (draining_ && !finished_) {
+            boost::asio::post(*strand_, [this]() { check(); });
+        }
+    }
+
+    // Starts draining: notifies all listeners, then calls done once activeCount() reaches zero
+    // or timeout has passed, whichever is first.
+    void begin(boost::asio::io_context& io_context, std::function<int()> activeCount,
+               std::chrono::seconds timeout, std::function<void()> done) {
+        strand_ = std::make_unique<boost::asio::strand<boost::asio::io_context::executor_type>>(io_context.get_executor());
+        deadline_ = std::make_unique<boost::asio::steady_timer>(*strand_, timeout);
+        activeCount_ = std::move(activeCount);
+        done_ = std::move(done);
+        draining_ = true;
+
+        std::size_t notified = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (drain_listener* listener : listeners_) {
+                listener->on_drain();
+            }
+            notified = listeners_.size();
+        }
+        log_info("Draining: drain notice sent to " + std::to_string(notified) + " stream(s).");
+
+        deadline_->async_wait([this](boost::system::error_code ec) {
+            if (!ec && strand_ != nullptr) {
+                close_remaining();
+            }
+        });
+        boost::asio::post(*strand_, [this]() { check(); });
+    }
+
+    // Streams still open after the deadline are closed rather than cut by stopping the loop.
+    static constexpr std::chrono::seconds close_grace{1};
+
+private:
+    void close_remaining() {
+        log_info("Shutdown timeout reached. Closing " + std::to_string(activeCount_()) + " active connection(s).");
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (drain_listener* listener : listeners_) {
+                listener->on_drain_timeout();
+            }
+        }
+        deadline_->expires_after(close_grace);
+        deadline_->async_wait([this](boost::system::error_code ec) {
+            if (!ec && strand_ != nullptr) {
+                log_info("Forcing shutdown with " + std::to_string(activeCount_()) + " active connection(s).");
+                finish();
+            }
+        });
+    }
+
+    void check() {
+        if (strand_ != nullptr && activeCount_() == 0) {
+            log_info("All connections closed. Shutting down gracefully.");
+            finish();
+        }
+    }
+
+    // Runs on the strand. The timer and strand are released now, while their io_context is
+    // certainly still alive; pending check() handlers keep the strand itself alive.
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+            deadline_.reset();
+            strand_.reset();
+        }
+        done_();
+    }
+
+    std::mutex mutex_;      // guards listeners_, finished_ and the strand
+    std::vector<drain_listener*> listeners_;
+    std::atomic<bool> draining_{false};
+    bool finished_ = false;
+    std::unique_ptr<boost::asio::strand<boost::asio::io_context::executor_type>> strand_;
+    std::unique_ptr<boost::asio::steady_timer> deadline_;
+    std::function<int()> activeCount_;
+    std::function<void()> done_;
+};
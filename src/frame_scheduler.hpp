@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "frame_trace.hpp"
+#include "handler_memory.hpp"
+#include "logging.hpp"
+#include "nc_pipeline.hpp"
+
+//
+// Receives a processed frame from the frame_scheduler. Called on the thread that ran the batch;
+// the implementation hops back to its own strand.
+//
+class batch_client {
+public:
+    virtual void on_frame_processed() = 0;
+
+protected:
+    ~batch_client() = default;
+};
+
+//
+// frame_scheduler: cross-session batching of NC work.
+//
+// With a batching window, sessions do not call process() from their own read handlers. They
+// queue the frame here, and once the oldest queued frame has waited window microseconds (or every
+// attached session has a frame queued, whichever is first) the whole batch is processed back to
+// back on one thread, grouped by model, before any completion runs. The engine then sees one
+// burst of same-model work instead of interleaved I/O, and the I/O handlers of all sessions run
+// after it. Each session has at most one frame in flight, so a batch never exceeds the number of
+// attached sessions and the queue never grows past its reserved capacity.
+//
+// Batches always run on the scheduler's own strand, never inside the submitting session's
+// handler: that handler is metered as its stream's I/O time, and the batch processes (and
+// completes) other streams' frames too, which would bill them to whichever tenant submitted last.
+//
+// The added latency is bounded by the window; batch sizes and the measured queueing delay are
+// logged at shutdown so the throughput / latency trade-off can be tuned. A zero window disables
+// the scheduler and sessions process inline.
+//
+// Sampled batches are traced as a "run batch" span of session 0 whose seq is the batch number,
+// so the frames' "process" spans show up nested inside it.
+//
+class frame_scheduler {
+public:
+    frame_scheduler(boost::asio::io_context& io_context, std::chrono::microseconds window, std::size_t capacity)
+        : strand_(boost::asio::make_strand(io_context)),
+          timer_(io_context),
+          window_(window)
+    {
+        pending_.reserve(capacity);
+        running_.reserve(capacity);
+    }
+
+    bool enabled() const {
+        return window_.count() > 0;
+    }
+
+    void attach() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++clients_;
+    }
+
+    void detach() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --clients_;
+    }
+
+    // Queues one frame; client.on_frame_processed() runs once out has been written.
+    void submit(batch_client& client, nc_pipeline& pipeline, const int16_t* in, int16_t* out) {
+        bool flushNow = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(entry{&client, &pipeline, in, out, std::chrono::steady_clock::now()});
+            if (pending_.size() >= clients_) {
+                flushNow = !flushPosted_;
+                flushPosted_ = true;
+            } else if (!timerArmed_) {
+                timerArmed_ = true;
+                arm_timer();
+            }
+        }
+        if (flushNow) {
+            boost::asio::post(strand_, make_custom_alloc_handler(flushMemory_, [this]() { flush(); }));
+        }
+    }
+
+    void print_stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (batches_ == 0) {
+            return;
+        }
+        log_info("#--- Batch scheduler stats ---"
+            "\n# - Window: " + std::to_string(window_.count()) + " us" +
+            "\n# - Batches: " + std::to_string(batches_) +
+            "\n# - Frames: " + std::to_string(frames_) +
+            "\n# - Mean batch: " + std::to_string(static_cast<double>(frames_) / static_cast<double>(batches_)) +
+            "\n# - Max batch: " + std::to_string(maxBatch_) +
+            "\n# - Mean queueing delay: " + std::to_string(totalDelayUs_ / frames_) + " us" +
+            "\n# - Max queueing delay: " + std::to_string(maxDelayUs_) + " us"
+        );
+    }
+
+private:
+    struct entry {
+        batch_client* client;
+        nc_pipeline* pipeline;
+        const int16_t* in;
+        int16_t* out;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // The timer is never cancelled: when it fires it flushes whatever is queued by then, which
+    // keeps one operation in flight and lets it reuse the same handler memory.
+    void arm_timer() {
+        timer_.expires_after(window_);
+        timer_.async_wait(boost::asio::bind_executor(strand_, make_custom_alloc_handler(timerMemory_,
+            [this](boost::system::error_code ec) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    timerArmed_ = false;
+                }
+                if (!ec) {
+                    flush();
+                }
+            }
+        )));
+    }
+
+    // Runs on strand_, so flushes from the timer and from a full queue never overlap.
+    void flush() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flushPosted_ = false;
+            running_.swap(pending_);
+        }
+        if (running_.empty()) {
+            return;
+        }
+
+        // Same-model frames run together, keeping that model's weights hot across the burst.
+        std::stable_sort(running_.begin(), running_.end(), [](const entry& a, const entry& b) {
+            return a.pipeline->model_id() < b.pipeline->model_id();
+        });
+        auto start = std::chrono::steady_clock::now();
+        for (auto& e : running_) {
+            e.pipeline->process(e.in, e.out);
+        }
+        uint64_t batch = runs_++;
+        if (tracer().sampled(0, batch)) {
+            tracer().record("run batch", 0, batch, start);
+        }
+
+        uint64_t delayUs = 0, maxDelayUs = 0;
+        for (auto& e : running_) {
+            auto us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(start - e.queued).count());
+            delayUs += us;
+            maxDelayUs = std::max(maxDelayUs, us);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++batches_;
+            frames_ += running_.size();
+            maxBatch_ = std::max(maxBatch_, running_.size());
+            totalDelayUs_ += delayUs;
+            maxDelayUs_ = std::max(maxDelayUs_, maxDelayUs);
+        }
+
+        for (auto& e : running_) {
+            e.client->on_frame_processed();
+        }
+        running_.clear();
+    }
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::steady_timer timer_;
+    handler_memory timerMemory_;
+    handler_memory flushMemory_;
+    std::chrono::microseconds window_;
+    std::mutex mutex_;      // guards the queue, counters and stats
+    std::vector<entry> pending_;
+    std::vector<entry> running_;
+    uint64_t runs_ = 0;     // only touched by flush(), on strand_
+    std::size_t clients_ = 0;
+    bool timerArmed_ = false;
+    bool flushPosted_ = false;
+    uint64_t batches_ = 0;
+    uint64_t frames_ = 0;
+    std::size_t maxBatch_ = 0;
+    uint64_t totalDelayUs_ = 0;
+    uint64_t maxDelayUs_ = 0;
+};
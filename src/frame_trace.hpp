@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logging.hpp"
+
+//
+// Tracing options; every = 0 disables tracing.
+//
+struct trace_config {
+    unsigned every = 0;                     // trace one of every N frames of each stream
+    std::string path = "apm-trace.json";    // where dumps are written
+    std::size_t ringEvents = 16384;         // spans kept per thread; older ones are overwritten
+};
+
+//
+// One timed step of one frame: what ran (name), for which stream (session) and which of its
+// frames (seq), on the thread whose ring holds it.
+//
+struct trace_span {
+    const char* name;       // a string literal
+    uint64_t session;
+    uint64_t seq;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+};
+
+//
+// frame_tracer: sampled frame-lifecycle spans, dumped as a Chrome trace-event JSON file that
+// chrome://tracing and ui.perfetto.dev open directly.
+//
+// A stream's frame is traced when (seq + session) % every == 0, so every step of a sampled frame
+// is recorded (read, batch wait, strand hop, process, write) and sampled frames of different
+// streams are spread out. Spans go to a fixed-size ring owned by the recording thread; only that
+// thread and a dump ever take the ring's lock, so recording never contends. With tracing off
+// the hot path pays one relaxed load and a branch per step, and takes no timestamps.
+//
+// dump() copies the rings on the calling thread (a quick memcpy) and formats and writes the file
+// on a short-lived thread, so a dump does not stall the streams it is meant to observe. The file
+// is written next to the target and renamed over it, so readers never see half a trace.
+//
+class frame_tracer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void configure(const trace_config& cfg) {
+        path_ = cfg.path;
+        ringEvents_ = std::max<std::size_t>(cfg.ringEvents, 1);
+        every_.store(cfg.every, std::memory_order_relaxed);
+        if (cfg.every > 0) {
+            log_info("Tracing one of every " + std::to_string(cfg.every) + " frames per stream; dumps go to " + path_);
+        }
+    }
+
+    bool enabled() const {
+        return every_.load(std::memory_order_relaxed) != 0;
+    }
+
+    bool sampled(uint64_t session, uint64_t seq) const {
+        unsigned every = every_.load(std::memory_order_relaxed);
+        return every != 0 && (seq + session) % every == 0;
+    }
+
+    uint64_t new_session() {
+        return sessions_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void record(const trace_span& span) {
+        thread_local trace_ring* ring = nullptr;
+        if (ring == nullptr) {
+            ring = add_ring();
+        }
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        ring->spans[ring->next++ % ring->spans.size()] = span;
+    }
+
+    void record(const char* name, uint64_t session, uint64_t seq, clock::time_point begin) {
+        record(trace_span{name, session, seq, begin, clock::now()});
+    }
+
+    // Starts writing the current contents of all rings to the configured path. Returns the
+    // number of spans written, or -1 when tracing is off or a dump is still being written.
+    long dump() {
+        if (!enabled() || dumping_.exchange(true)) {
+            return -1;
+        }
+        auto snapshot = std::make_shared<std::vector<thread_spans>>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& ring : rings_) {
+                std::lock_guard<std::mutex> ringLock(ring->mutex);
+                std::size_t count = std::min<uint64_t>(ring->next, ring->spans.size());
+                if (count > 0) {
+                    snapshot->push_back(thread_spans{ring->tid, ring->name,
+                        std::vector<trace_span>(ring->spans.begin(), ring->spans.begin() + static_cast<std::ptrdiff_t>(count))});
+                }
+            }
+        }
+        long total = 0;
+        for (auto& t : *snapshot) {
+            total += static_cast<long>(t.spans.size());
+        }
+        std::thread([this, snapshot, path = path_]() {
+            write_json(*snapshot, path);
+            dumping_ = false;
+        }).detach();
+        return total;
+    }
+
+    const std::string& path() const {
+        return path_;
+    }
+
+private:
+    struct trace_ring {
+        std::mutex mutex;
+        std::vector<trace_span> spans;
+        uint64_t next = 0;
+        long tid;
+        std::string name;
+    };
+
+    struct thread_spans {
+        long tid;
+        std::string name;
+        std::vector<trace_span> spans;
+    };
+
+    // Rings live as long as the process; there is one per thread that ever recorded a span.
+    trace_ring* add_ring() {
+        auto ring = std::make_unique<trace_ring>();
+        ring->spans.resize(ringEvents_);
+        ring->tid = static_cast<long>(::syscall(SYS_gettid));
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        ring->name = name;
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(std::move(ring));
+        return rings_.back().get();
+    }
+
+    static void write_json(const std::vector<thread_spans>& threads, const std::string& path) {
+        std::string tmp = path + ".tmp";
+        std::FILE* file = std::fopen(tmp.c_str(), "w");
+        if (file == nullptr) {
+            log_error("Trace: cannot create " + tmp);
+            return;
+        }
+        long pid = static_cast<long>(::getpid());
+        long count = 0;
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"apm-krisp-nc\"}}", pid);
+        for (auto& t : threads) {
+            std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                         pid, t.tid, t.name.c_str());
+            for (auto& s : t.spans) {
+                auto ts = std::chrono::duration<double, std::micro>(s.begin.time_since_epoch()).count();
+                auto dur = std::chrono::duration<double, std::micro>(s.end - s.begin).count();
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                                   "\"pid\":%ld,\"tid\":%ld,\"args\":{\"session\":%llu,\"seq\":%llu}}",
+                             s.name, ts, dur, pid, t.tid, static_cast<unsigned long long>(s.session),
+                             static_cast<unsigned long long>(s.seq));
+                ++count;
+            }
+        }
+        std::fprintf(file, "\n]}\n");
+        bool ok = std::fclose(file) == 0;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            log_error("Trace: cannot write " + path);
+            return;
+        }
+        log_info("Trace: wrote " + std::to_string(count) + " spans to " + path);
+    }
+
+    std::atomic<unsigned> every_{0};
+    std::atomic<uint64_t> sessions_{0};
+    std::atomic<bool> dumping_{false};
+    std::string path_;
+    std::size_t ringEvents_ = 1;
+    std::mutex mutex_;      // guards rings_
+    std::vector<std::unique_ptr<trace_ring>> rings_;
+};
+
+//
+// The process-wide tracer. Intentionally leaked, like the slab pools: spans may be recorded and
+// a dump may still be writing while static objects are torn down at exit.
+//
+inline frame_tracer& tracer() {
+    static frame_tracer* instance = new frame_tracer();
+    return *instance;
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+
+#include "admin_server.hpp"
+#include "admission.hpp"
+#include "logging.hpp"
+#include "ws_session.hpp"
+
+//
+// Several worker processes on one host behind a front end.
+//
+// The front end owns the client-facing stream and WebSocket ports but runs no model and no
+// stream. It keeps a Unix-socket link to each worker's --handoff-socket; over it each worker
+// reports its load every report_interval as one line
+//
+//   load active=3 max=10 spare=7 ready=1
+//
+// (active and max of the stream listeners' connection slots, which handed-off connections take;
+// spare is their free slots, further limited by the CPU headroom as on GET /capacity; ready as on
+// GET /ready) and the front end passes each accepted
+// client connection on as a descriptor (SCM_RIGHTS) with a one-byte payload naming the port it
+// arrived on. The worker's session then reads the connection from its first byte, handshake
+// included, exactly as if it had accepted it itself: no audio ever passes through the front end.
+//
+static constexpr char handoff_stream = 'T';
+static constexpr char handoff_websocket = 'W';
+static constexpr std::chrono::milliseconds report_interval(100);
+
+//
+// handoff_listener: the worker side. Accepts front-end links on a Unix socket, reports the
+// worker's load on each and hands every connection received on them to adopt().
+//
+// close() stops accepting links but keeps reporting on the open ones, now with ready=0, so a
+// front end stops sending connections as soon as the worker starts draining. Connections that
+// still arrive are refused with the usual busy notice by admission_control.
+//
+class handoff_listener {
+public:
+    using unix_socket = boost::asio::local::stream_protocol;
+    using adopt_handler = std::function<void(char kind, int fd)>;
+
+    // streamSlots is the stream listeners' connection limit; status covers the whole process.
+    handoff_listener(boost::asio::io_context& io_context, const std::string& path, admin_status status,
+                     int streamSlots, adopt_handler adopt)
+        : acceptor_(io_context, fresh_endpoint(path)),
+          path_(path),
+          status_(std::move(status)),
+          streamSlots_(streamSlots),
+          cpu_(io_context),
+          adopt_(std::move(adopt))
+    {
+        log_info("Handoff socket listening on " + path_);
+        do_accept();
+    }
+
+    void close() {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+        ::unlink(path_.c_str());
+    }
+
+private:
+    class link : public std::enable_shared_from_this<link> {
+    public:
+        link(unix_socket::socket socket, handoff_listener& owner)
+            : socket_(std::move(socket)),
+              timer_(socket_.get_executor()),
+              owner_(owner)
+        {
+        }
+
+        void start() {
+            log_info("Front end linked on " + owner_.path_);
+            report(shared_from_this());
+            wait_handoff(shared_from_this());
+        }
+
+    private:
+        void report(std::shared_ptr<link> self) {
+            // Handed-off connections go through the stream listeners' admission_control, so only
+            // its slots count; RTP and io_uring streams only weigh in through the CPU estimate.
+            auto capacity = capacity_estimate::of(owner_.status_, owner_.cpu_);
+            int active = owner_.status_.admission().active;
+            int spare = std::min(std::max(0, owner_.streamSlots_ - active), capacity.spare);
+            bool ready = owner_.status_.modelLoaded.load() && !owner_.status_.drain.draining();
+            line_ = "load active=" + std::to_string(active) + " max=" + std::to_string(owner_.streamSlots_) +
+                    " spare=" + std::to_string(spare) + " ready=" + (ready ? "1" : "0") + "\n";
+            boost::asio::async_write(socket_, boost::asio::buffer(line_),
+                [this, self](boost::system::error_code ec, std::size_t) {
+                    if (ec) {
+                        close();
+                        return;
+                    }
+                    timer_.expires_after(report_interval);
+                    timer_.async_wait([this, self](boost::system::error_code ec) {
+                        if (!ec) {
+                            report(std::move(self));
+                        }
+                    });
+                }
+            );
+        }
+
+        void wait_handoff(std::shared_ptr<link> self) {
+            socket_.async_wait(unix_socket::socket::wait_read,
+                [this, self](boost::system::error_code ec) {
+                    if (!ec && receive()) {
+                        wait_handoff(std::move(self));
+                    } else {
+                        close();
+                    }
+                }
+            );
+        }
+
+        // Takes every connection that has arrived. Each is one byte with one descriptor, so a
+        // one-byte read never mixes the descriptors of two connections. Returns false once the
+        // front end has gone.
+        bool receive() {
+            for (;;) {
+                char kind = 0;
+                iovec iov{&kind, 1};
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+                msghdr msg{};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                ssize_t n = recvmsg(socket_.native_handle(), &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+                if (n < 0) {
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                }
+                if (n == 0) {
+                    log_info("Front end unlinked from " + owner_.path_);
+                    return false;
+                }
+                int fd = -1;
+                for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+                    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS &&
+                        c->cmsg_len >= CMSG_LEN(sizeof(int))) {
+                        std::memcpy(&fd, CMSG_DATA(c), sizeof(int));
+                    }
+                }
+                if (fd < 0) {
+                    log_error("Handoff without a connection descriptor");
+                } else if (kind != handoff_stream && kind != handoff_websocket) {
+                    log_error("Handoff of unknown kind " + std::to_string(static_cast<int>(kind)));
+                    ::close(fd);
+                } else {
+                    owner_.adopt_(kind, fd);
+                }
+            }
+        }
+
+        void close() {
+            boost::system::error_code ignored;
+            timer_.cancel();
+            socket_.close(ignored);
+        }
+
+        unix_socket::socket socket_;
+        boost::asio::steady_timer timer_;
+        handoff_listener& owner_;
+        std::string line_;
+    };
+
+    // Replaces a stale socket file left by a previous run.
+    static unix_socket::endpoint fresh_endpoint(const std::string& path) {
+        ::unlink(path.c_str());
+        return unix_socket::endpoint(path);
+    }
+
+    void do_accept() {
+        // Each link runs on its own strand: its report and handoff chains share the socket.
+        acceptor_.async_accept(boost::asio::make_strand(acceptor_.get_executor()),
+            [this](boost::system::error_code ec, unix_socket::socket socket) {
+                if (!ec) {
+                    std::make_shared<link>(std::move(socket), *this)->start();
+                } else if (ec != boost::asio::error::operation_aborted) {
+                    log_error("Handoff accept error: " + ec.message());
+                }
+                if (acceptor_.is_open())
+                    do_accept();
+            }
+        );
+    }
+
+    unix_socket::acceptor acceptor_;
+    std::string path_;
+    admin_status status_;
+    int streamSlots_;
+    cpu_monitor cpu_;
+    adopt_handler adopt_;
+};
+
+//
+// Front-end options: the client-facing ports and the workers' handoff sockets.
+//
+struct front_end_config {
+    unsigned short port = 0;
+    unsigned short wsPort = 0;                  // 0: no WebSocket port
+    std::vector<std::string> workers;
+};
+
+//
+// front_end: accepts client connections and hands each to the least-loaded worker.
+//
+// A worker is eligible while its link is up, its last report said ready and is at most
+// stale_after old. Among those, the one with the most spare streams wins, less the connections
+// already sent to it since that report, so a burst is spread out before the next reports arrive;
+// ties go to the worker with fewer active streams. A worker whose spare is used up still gets
+// connections when no other has any: its accept queue then decides, as it would for a direct
+// client. Only when no worker is eligible does the front end itself send the busy response.
+//
+// Links that fail, or refuse a descriptor, are dropped and reconnected with backoff, so workers
+// may be started and restarted in any order. Everything runs on one thread; a handoff is a
+// single non-blocking sendmsg() per connection.
+//
+class front_end {
+public:
+    using tcp = boost::asio::ip::tcp;
+    using unix_socket = boost::asio::local::stream_protocol;
+
+    static constexpr std::chrono::milliseconds stale_after{1000};
+    static constexpr std::chrono::milliseconds min_backoff{100};
+    static constexpr std::chrono::milliseconds max_backoff{2000};
+
+    front_end(boost::asio::io_context& io_context, const front_end_config& cfg)
+        : io_context_(io_context),
+          acceptor_(io_context, tcp::endpoint(tcp::v4(), cfg.port))
+    {
+        log_info("Front end listening on " + acceptor_.local_endpoint().address().to_string() +
+                 ":" + std::to_string(acceptor_.local_endpoint().port()) + " for " +
+                 std::to_string(cfg.workers.size()) + " worker(s)");
+        if (cfg.wsPort > 0) {
+            wsAcceptor_ = std::make_unique<tcp::acceptor>(io_context, tcp::endpoint(tcp::v4(), cfg.wsPort));
+            log_info("Front end WebSocket listening on " + wsAcceptor_->local_endpoint().address().to_string() +
+                     ":" + std::to_string(wsAcceptor_->local_endpoint().port()));
+        }
+        for (const auto& path : cfg.workers) {
+            workers_.push_back(std::make_unique<worker>(io_context, path));
+            connect(*workers_.back());
+        }
+        do_accept(acceptor_, handoff_stream);
+        if (wsAcceptor_) {
+            do_accept(*wsAcceptor_, handoff_websocket);
+        }
+    }
+
+    // Stops accepting and drops the worker links. Connections already handed off belong to the
+    // workers and are not affected.
+    void shutdown() {
+        stopped_ = true;
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+        if (wsAcceptor_) {
+            wsAcceptor_->close(ec);
+        }
+        for (auto& w : workers_) {
+            w->retry.cancel();
+            w->socket.close(ec);
+            log_info("Front end: " + std::to_string(w->handedOff) + " connection(s) handed to " + w->path);
+        }
+        log_info("Front end: " + std::to_string(handedOff_) + " handed off | " + std::to_string(refused_) +
+                 " refused with no worker available");
+    }
+
+private:
+    struct worker {
+        worker(boost::asio::io_context& io_context, const std::string& workerPath)
+            : path(workerPath),
+              socket(io_context),
+              retry(io_context)
+        {
+        }
+
+        std::string path;
+        unix_socket::socket socket;
+        boost::asio::steady_timer retry;
+        boost::asio::streambuf reports;
+        std::chrono::milliseconds backoff = min_backoff;
+        bool linked = false;
+        bool ready = false;
+        int active = 0;
+        int spare = 0;
+        int sentSinceReport = 0;
+        std::chrono::steady_clock::time_point reported;
+        uint64_t handedOff = 0;
+    };
+
+    void connect(worker& w) {
+        w.socket = unix_socket::socket(io_context_);
+        w.socket.async_connect(unix_socket::endpoint(w.path),
+            [this, &w](boost::system::error_code ec) {
+                if (stopped_) {
+                    return;
+                }
+                if (ec) {
+                    retry(w);
+                    return;
+                }
+                w.linked = true;
+                w.backoff = min_backoff;
+                log_info("Front end: linked to worker " + w.path);
+                read_report(w);
+            }
+        );
+    }
+
+    void retry(worker& w) {
+        boost::system::error_code ignored;
+        w.socket.close(ignored);
+        w.retry.expires_after(w.backoff);
+        w.backoff = std::min(w.backoff * 2, max_backoff);
+        w.retry.async_wait([this, &w](boost::system::error_code ec) {
+            if (!ec && !stopped_) {
+                connect(w);
+            }
+        });
+    }
+
+    void lost(worker& w, const std::string& why) {
+        if (!w.linked) {
+            return;
+        }
+        w.linked = false;
+        w.ready = false;
+        log_error("Front end: lost worker " + w.path + ": " + why);
+        retry(w);
+    }
+
+    void read_report(worker& w) {
+        boost::asio::async_read_until(w.socket, w.reports, '\n',
+            [this, &w](boost::system::error_code ec, std::size_t) {
+                if (stopped_) {
+                    return;
+                }
+                if (ec) {
+                    lost(w, ec.message());
+                    return;
+                }
+                std::istream in(&w.reports);
+                std::string line;
+                std::getline(in, line);
+                int active = 0, max = 0, spare = 0, ready = 0;
+                // Lines this version does not know are skipped, so workers may report more.
+                if (std::sscanf(line.c_str(), "load active=%d max=%d spare=%d ready=%d", &active, &max, &spare,
+                                &ready) == 4) {
+                    if ((ready != 0) != w.ready) {
+                        log_info("Front end: worker " + w.path + (ready != 0 ? " is ready" : " is not ready") +
+                                 " | Active: " + std::to_string(active) + "/" + std::to_string(max));
+                    }
+                    w.ready = ready != 0;
+                    w.active = active;
+                    w.spare = spare;
+                    w.sentSinceReport = 0;
+                    w.reported = std::chrono::steady_clock::now();
+                }
+                read_report(w);
+            }
+        );
+    }
+
+    worker* pick() {
+        auto now = std::chrono::steady_clock::now();
+        worker* best = nullptr;
+        int bestScore = 0;
+        for (auto& w : workers_) {
+            if (!w->linked || !w->ready || now - w->reported > stale_after) {
+                continue;
+            }
+            // A report already on its way when a connection is sent may not count it yet; the
+            // next one does.
+            int score = w->spare - w->sentSinceReport;
+            if (best == nullptr || score > bestScore ||
+                (score == bestScore && w->active + w->sentSinceReport < best->active + best->sentSinceReport)) {
+                best = w.get();
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    bool send_descriptor(worker& w, char kind, int fd) {
+        iovec iov{&kind, 1};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(c), &fd, sizeof(int));
+        // Never blocks: a worker too busy to take a descriptor is treated like a lost one.
+        return sendmsg(w.socket.native_handle(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == 1;
+    }
+
+    void hand_off(tcp::socket socket, char kind) {
+        while (worker* w = pick()) {
+            if (send_descriptor(*w, kind, socket.native_handle())) {
+                ++w->sentSinceReport;
+                ++w->handedOff;
+                ++handedOff_;
+                // The worker holds its own descriptor now; closing ours leaves the connection open.
+                boost::system::error_code ignored;
+                socket.close(ignored);
+                return;
+            }
+            lost(*w, std::string("handoff failed: ") + std::strerror(errno));
+        }
+        ++refused_;
+        log_error("Front end: no worker available. Rejecting connection");
+        if (kind == handoff_websocket) {
+            ws_session::reject_busy(std::move(socket));
+        } else {
+            send_busy_notice(socket);
+        }
+    }
+
+    void do_accept(tcp::acceptor& acceptor, char kind) {
+        acceptor.async_accept(
+            [this, &acceptor, kind](boost::system::error_code ec, tcp::socket socket) {
+                if (!ec) {
+                    hand_off(std::move(socket), kind);
+                } else if (ec != boost::asio::error::operation_aborted) {
+                    log_error("Front end accept error: " + ec.message());
+                }
+                if (acceptor.is_open())
+                    do_accept(acceptor, kind);
+            }
+        );
+    }
+
+    boost::asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    std::unique_ptr<tcp::acceptor> wsAcceptor_;
+    std::vector<std::unique_ptr<worker>> workers_;
+    bool stopped_ = false;
+    uint64_t handedOff_ = 0;
+    uint64_t refused_ = 0;
+};
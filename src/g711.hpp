@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+//
+// G.711 companding (ITU-T G.711) for the RTP transport: PCMU (mu-law) and PCMA (A-law).
+// Both operate on 16-bit linear samples.
+//
+
+inline uint8_t linear_to_ulaw(int16_t pcm) {
+    constexpr int bias = 0x84;
+    constexpr int clip = 32635;
+
+    int sample = pcm;
+    int sign = 0;
+    if (sample < 0) {
+        sign = 0x80;
+        sample = -sample;
+    }
+    if (sample > clip)
+        sample = clip;
+    sample += bias;
+
+    int exponent = 7;
+    for (int mask = 0x4000; (sample & mask) == 0 && exponent > 0; mask >>= 1)
+        --exponent;
+    int mantissa = (sample >> (exponent + 3)) & 0x0F;
+    return static_cast<uint8_t>(~(sign | (exponent << 4) | mantissa));
+}
+
+inline int16_t ulaw_to_linear(uint8_t ulaw) {
+    constexpr int bias = 0x84;
+
+    int u = ~ulaw & 0xFF;
+    int t = ((u & 0x0F) << 3) + bias;
+    t <<= (u & 0x70) >> 4;
+    return static_cast<int16_t>((u & 0x80) ? (bias - t) : (t - bias));
+}
+
+inline uint8_t linear_to_alaw(int16_t pcm) {
+    constexpr int clip = 32635;
+
+    int sample = pcm;
+    int sign = 0x80;
+    if (sample < 0) {
+        sign = 0;
+        sample = -sample;
+    }
+    if (sample > clip)
+        sample = clip;
+
+    int compressed;
+    if (sample >= 256) {
+        int exponent = 1;
+        for (int v = sample >> 8; v > 1; v >>= 1)
+            ++exponent;
+        int mantissa = (sample >> (exponent + 3)) & 0x0F;
+        compressed = (exponent << 4) | mantissa;
+    } else {
+        compressed = sample >> 4;
+    }
+    return static_cast<uint8_t>(compressed ^ (sign ^ 0x55));
+}
+
+inline int16_t alaw_to_linear(uint8_t alaw) {
+    int a = alaw ^ 0x55;
+    int t = (a & 0x0F) << 4;
+    int segment = (a & 0x70) >> 4;
+    switch (segment) {
+    case 0:
+        t += 8;
+        break;
+    case 1:
+        t += 0x108;
+        break;
+    default:
+        t += 0x108;
+        t <<= segment - 1;
+        break;
+    }
+    return static_cast<int16_t>((a & 0x80) ? t : -t);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+//
+// Recycled handler memory for the per-frame asynchronous operations.
+//
+// Every async_read / async_write / async_wait needs storage for its operation state. Asio takes
+// that storage from the handler's associated allocator; by default it comes from a small
+// per-thread cache that several concurrent sessions (and the strand's own queue) compete for, so
+// it falls back to the heap under load. A session instead owns one handler_memory per chain of
+// operations (read, write, playout timer); since each chain has at most one operation in flight,
+// the single block is always free again by the time the next operation starts.
+//
+class handler_memory {
+public:
+    handler_memory() = default;
+    handler_memory(const handler_memory&) = delete;
+    handler_memory& operator=(const handler_memory&) = delete;
+
+    void* allocate(std::size_t size) {
+        if (!inUse_ && size <= sizeof(storage_)) {
+            inUse_ = true;
+            return &storage_;
+        }
+        // Larger or overlapping operations are unexpected; serve them from the heap rather than fail.
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        if (pointer == &storage_) {
+            inUse_ = false;
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    // Comfortably larger than a composed read/write op bound to a strand.
+    typename std::aligned_storage<1024, alignof(std::max_align_t)>::type storage_;
+    bool inUse_ = false;
+};
+
+// Minimal allocator handing out a handler_memory block; used as a handler's associated allocator.
+template <typename T>
+class handler_allocator {
+public:
+    using value_type = T;
+
+    explicit handler_allocator(handler_memory& memory) : memory_(memory) {}
+
+    template <typename U>
+    handler_allocator(const handler_allocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const handler_allocator& other) const noexcept { return &memory_ == &other.memory_; }
+    bool operator!=(const handler_allocator& other) const noexcept { return &memory_ != &other.memory_; }
+
+    T* allocate(std::size_t n) const {
+        return static_cast<T*>(memory_.allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t) const {
+        memory_.deallocate(pointer);
+    }
+
+private:
+    template <typename> friend class handler_allocator;
+    handler_memory& memory_;
+};
+
+// Wraps a completion handler so Asio allocates its operation from the given handler_memory.
+template <typename Handler>
+class custom_alloc_handler {
+public:
+    using allocator_type = handler_allocator<Handler>;
+
+    custom_alloc_handler(handler_memory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    handler_memory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_memory& memory, Handler handler) {
+    return custom_alloc_handler<Handler>(memory, std::move(handler));
+}
+
+// Strand over the concrete io_context executor. Boost 1.74's strand over the type-erased
+// any_io_executor performs a polymorphic property query on every dispatch, which allocates.
+using session_strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+inline session_strand make_session_strand(const boost::asio::any_io_executor& executor) {
+    auto& context = boost::asio::query(executor, boost::asio::execution::context);
+    return boost::asio::make_strand(static_cast<boost::asio::io_context&>(context));
+}
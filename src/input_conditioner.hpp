@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//
+// What the conditioning stage does for a stream:
+//   off      nothing; frames go to the model untouched
+//   measure  per-frame peak, RMS, DC offset, clipping and silence are measured and exported as
+//            stats, but the audio is not changed
+//   on       as measure, and the DC offset is removed before the model and frames of digital
+//            silence bypass the model
+//
+enum class conditioning_mode { off, measure, on };
+
+inline const char* to_string(conditioning_mode mode) {
+    switch (mode) {
+    case conditioning_mode::measure:
+        return "measure";
+    case conditioning_mode::on:
+        return "on";
+    default:
+        return "off";
+    }
+}
+
+inline bool parse_conditioning_mode(const std::string& text, conditioning_mode& mode) {
+    if (text == "off") {
+        mode = conditioning_mode::off;
+    } else if (text == "measure") {
+        mode = conditioning_mode::measure;
+    } else if (text == "on") {
+        mode = conditioning_mode::on;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//
+// One pass over a frame of PCM16 samples.
+//
+struct frame_levels {
+    int64_t sum = 0;            // of all samples, for the DC estimate
+    uint64_t sumSquares = 0;
+    int min = 0;
+    int max = 0;
+    unsigned clipped = 0;       // samples at or beyond +/-clip_level
+};
+
+//
+// The per-frame kernels, with an SSE2 version (the x86-64 baseline, so no runtime dispatch is
+// needed) and a portable one that other targets use and the benchmark checks the SSE2 one
+// against. A 20-ms frame is 160 to 960 samples, so both handle any length, including a tail that
+// is not a multiple of the vector width.
+//
+namespace conditioning_kernels {
+
+constexpr int clip_level = 32704;   // within 64 LSB (0.02 dB) of full scale
+
+inline frame_levels measure_scalar(const int16_t* x, std::size_t n) {
+    frame_levels l;
+    if (n == 0) {
+        return l;
+    }
+    l.min = l.max = x[0];
+    for (std::size_t i = 0; i < n; ++i) {
+        int v = x[i];
+        l.sum += v;
+        l.sumSquares += static_cast<uint64_t>(v * v);
+        l.min = std::min(l.min, v);
+        l.max = std::max(l.max, v);
+        l.clipped += (v >= clip_level || v <= -clip_level) ? 1u : 0u;
+    }
+    return l;
+}
+
+// Subtracts offset from every sample, saturating at the PCM16 range.
+inline void subtract_offset_scalar(const int16_t* in, int16_t* out, std::size_t n, int offset) {
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i] - offset, -32768, 32767));
+    }
+}
+
+#if defined(__SSE2__)
+
+inline frame_levels measure_sse2(const int16_t* x, std::size_t n) {
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clipHigh = _mm_set1_epi16(clip_level - 1);
+    const __m128i clipLow = _mm_set1_epi16(-(clip_level - 1));
+    __m128i sum = zero;                         // 4 x int32: at most 2 * 32768 per lane and step
+    __m128i squares = zero;                     // 2 x uint64
+    __m128i vmin = _mm_set1_epi16(32767);
+    __m128i vmax = _mm_set1_epi16(-32768);
+    __m128i clipped = zero;                     // 8 x int16 counters, one step each
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(v, ones));
+        // A pair of squares is at most 2^31, which fits in an unsigned 32-bit lane; widen each
+        // step so long frames cannot overflow.
+        __m128i sq = _mm_madd_epi16(v, v);
+        squares = _mm_add_epi64(squares, _mm_unpacklo_epi32(sq, zero));
+        squares = _mm_add_epi64(squares, _mm_unpackhi_epi32(sq, zero));
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+        __m128i over = _mm_or_si128(_mm_cmpgt_epi16(v, clipHigh), _mm_cmplt_epi16(v, clipLow));
+        clipped = _mm_sub_epi16(clipped, over);
+    }
+
+    alignas(16) int32_t sums[4];
+    alignas(16) uint64_t sq[2];
+    alignas(16) int16_t mins[8], maxs[8], clips[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(sq), squares);
+    _mm_store_si128(reinterpret_cast<__m128i*>(mins), vmin);
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+    _mm_store_si128(reinterpret_cast<__m128i*>(clips), clipped);
+
+    frame_levels l = measure_scalar(x + i, n - i);
+    if (i == 0) {
+        return l;
+    }
+    if (i == n) {
+        l.min = 32767;
+        l.max = -32768;
+    }
+    for (int k = 0; k < 4; ++k) {
+        l.sum += sums[k];
+    }
+    l.sumSquares += sq[0] + sq[1];
+    for (int k = 0; k < 8; ++k) {
+        l.min = std::min<int>(l.min, mins[k]);
+        l.max = std::max<int>(l.max, maxs[k]);
+        l.clipped += static_cast<uint16_t>(clips[k]);
+    }
+    return l;
+}
+
+inline void subtract_offset_sse2(const int16_t* in, int16_t* out, std::size_t n, int offset) {
+    const __m128i o = _mm_set1_epi16(static_cast<int16_t>(std::clamp(offset, -32768, 32767)));
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_subs_epi16(v, o));
+    }
+    subtract_offset_scalar(in + i, out + i, n - i, offset);
+}
+
+#endif
+
+inline frame_levels measure(const int16_t* x, std::size_t n) {
+#if defined(__SSE2__)
+    return measure_sse2(x, n);
+#else
+    return measure_scalar(x, n);
+#endif
+}
+
+inline void subtract_offset(const int16_t* in, int16_t* out, std::size_t n, int offset) {
+#if defined(__SSE2__)
+    subtract_offset_sse2(in, out, n, offset);
+#else
+    subtract_offset_scalar(in, out, n, offset);
+#endif
+}
+
+}
+
+//
+// input_conditioner: the conditioning stage of one stream, run on every frame before the model.
+//
+// Each frame is measured in one vectorized pass. The DC offset is tracked across frames with a
+// slow one-pole average of the frame means (about 0.4 s), so speech itself is not treated as
+// offset. In mode on it is subtracted into a scratch copy, leaving the caller's input intact
+// for the tap. Figures after DC removal (peak, RMS, silence) are derived from the same pass
+// instead of measuring again.
+//
+// A frame whose peak stays within silence_peak, as received or after DC removal, is digital
+// silence (a muted or idle trunk) and does not need the model. Clipping is only detected and
+// counted: the model still runs on clipped frames, since passing them through unprocessed would
+// leave them louder.
+//
+// Only the stream's processing path writes; the stats are atomics so a control command may read
+// them while a batch runs on another thread.
+//
+class input_conditioner {
+public:
+    static constexpr int silence_peak = 8;              // -72 dBFS
+    static constexpr double dc_smoothing = 0.05;        // per 20-ms frame
+
+    explicit input_conditioner(std::size_t frameSamples)
+        : scratch_(frameSamples)
+    {
+    }
+
+    // Measures a frame and returns the samples to process: in itself, or the copy with the DC
+    // offset removed when removeDc is set. The copy stays valid until the next call.
+    const int16_t* condition(const int16_t* in, bool removeDc) {
+        std::size_t n = scratch_.size();
+        frame_levels l = conditioning_kernels::measure(in, n);
+        double count = static_cast<double>(n);
+        // A frame that is silent as received (a muted leg sends zeros) says nothing about the
+        // offset and is passed on unchanged, rather than turned into a step of -offset.
+        bool rawSilent = std::max(std::abs(l.max), std::abs(l.min)) <= silence_peak;
+        if (!rawSilent) {
+            dc_ += dc_smoothing * (static_cast<double>(l.sum) / count - dc_);
+        }
+
+        int offset = removeDc && !rawSilent ? static_cast<int>(std::lround(dc_)) : 0;
+        double d = offset;
+        double squares = static_cast<double>(l.sumSquares) - 2 * d * static_cast<double>(l.sum) + count * d * d;
+        int peak = std::max(std::abs(l.max - offset), std::abs(l.min - offset));
+        silent_ = peak <= silence_peak;
+
+        frames_.store(frames_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (silent_) {
+            silentFrames_.store(silentFrames_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        if (l.clipped > 0) {
+            clippedFrames_.store(clippedFrames_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            clippedSamples_.store(clippedSamples_.load(std::memory_order_relaxed) + l.clipped, std::memory_order_relaxed);
+        }
+        peak_.store(std::min(peak, 32768), std::memory_order_relaxed);
+        peakMax_.store(std::max(peakMax_.load(std::memory_order_relaxed), peak_.load(std::memory_order_relaxed)),
+                       std::memory_order_relaxed);
+        double rms = std::sqrt(std::max(0.0, squares / count));
+        rms_.store(rms, std::memory_order_relaxed);
+        rmsSum_.store(rmsSum_.load(std::memory_order_relaxed) + rms, std::memory_order_relaxed);
+        dcOffset_.store(dc_, std::memory_order_relaxed);
+
+        if (offset == 0) {
+            return in;
+        }
+        conditioning_kernels::subtract_offset(in, scratch_.data(), n, offset);
+        return scratch_.data();
+    }
+
+    // Whether the last frame was digital silence.
+    bool silent() const {
+        return silent_;
+    }
+
+    struct stats {
+        uint64_t frames;
+        uint64_t silentFrames;
+        uint64_t clippedFrames;
+        uint64_t clippedSamples;
+        double peakDbfs;        // last frame
+        double rmsDbfs;         // last frame
+        double maxPeakDbfs;
+        double meanRmsDbfs;
+        double dcOffset;        // in LSB
+    };
+
+    stats get_stats() const {
+        uint64_t frames = frames_.load(std::memory_order_relaxed);
+        return stats{frames,
+                     silentFrames_.load(std::memory_order_relaxed),
+                     clippedFrames_.load(std::memory_order_relaxed),
+                     clippedSamples_.load(std::memory_order_relaxed),
+                     dbfs(peak_.load(std::memory_order_relaxed)),
+                     dbfs(rms_.load(std::memory_order_relaxed)),
+                     dbfs(peakMax_.load(std::memory_order_relaxed)),
+                     dbfs(frames > 0 ? rmsSum_.load(std::memory_order_relaxed) / static_cast<double>(frames) : 0),
+                     dcOffset_.load(std::memory_order_relaxed)};
+    }
+
+    // Level relative to full scale, floored at -96 dBFS (the PCM16 noise floor).
+    static double dbfs(double level) {
+        return level > 0 ? std::max(-96.0, 20 * std::log10(level / 32768.0)) : -96.0;
+    }
+
+private:
+    std::vector<int16_t> scratch_;
+    double dc_ = 0;
+    bool silent_ = false;
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> silentFrames_{0};
+    std::atomic<uint64_t> clippedFrames_{0};
+    std::atomic<uint64_t> clippedSamples_{0};
+    std::atomic<int> peak_{0};
+    std::atomic<int> peakMax_{0};
+    std::atomic<double> rms_{0};
+    std::atomic<double> rmsSum_{0};
+    std::atomic<double> dcOffset_{0};
+};
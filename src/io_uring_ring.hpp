@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//
+// io_uring_ring: minimal wrapper around the raw io_uring system calls (no liburing dependency).
+//
+// One submission queue and one completion queue mapped from the kernel. Callers fill entries
+// from get_sqe(), then submit_and_wait() hands every queued entry to the kernel in a single
+// io_uring_enter() and blocks for at least one completion; for_each_cqe() consumes completions.
+// Only the owning thread may use the ring.
+//
+class io_uring_ring {
+public:
+    explicit io_uring_ring(unsigned entries) {
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) {
+            throw std::runtime_error("io_uring_setup: " + std::string(std::strerror(errno)));
+        }
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0) {
+            close(fd_);
+            throw std::runtime_error("io_uring: kernel 5.6 or newer required");
+        }
+
+        std::size_t sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        std::size_t cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ringBytes_ = sqRingBytes > cqRingBytes ? sqRingBytes : cqRingBytes;
+        ring_ = map(ringBytes_, IORING_OFF_SQ_RING);
+        sqeBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqeBytes_, IORING_OFF_SQES));
+
+        auto* base = static_cast<char*>(ring_);
+        sqHead_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sqEntries_ = params.sq_entries;
+        sqArray_ = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        localTail_ = *sqTail_;
+    }
+
+    ~io_uring_ring() {
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqeBytes_);
+        }
+        if (ring_ != nullptr) {
+            munmap(ring_, ringBytes_);
+        }
+        close(fd_);
+    }
+
+    io_uring_ring(const io_uring_ring&) = delete;
+    io_uring_ring& operator=(const io_uring_ring&) = delete;
+
+    // Registers fixed buffers for IORING_OP_READ_FIXED / IORING_OP_WRITE_FIXED (buf_index = slot).
+    void register_buffers(const iovec* buffers, unsigned count) {
+        if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers, count) < 0) {
+            throw std::runtime_error("io_uring_register: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    // Next free submission entry, zeroed; nullptr if the queue is full (submit first).
+    io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (localTail_ - head >= sqEntries_) {
+            return nullptr;
+        }
+        unsigned index = localTail_ & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray_[index] = index;
+        ++localTail_;
+        return sqe;
+    }
+
+    // Publishes queued entries and waits for at least waitFor completions. Returns the number of
+    // entries submitted with this call.
+    unsigned submit_and_wait(unsigned waitFor) {
+        unsigned pending = localTail_ - *sqTail_;
+        __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+        for (;;) {
+            long rc = syscall(__NR_io_uring_enter, fd_, pending, waitFor,
+                              waitFor > 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+            if (rc >= 0) {
+                ++enterCalls_;
+                return static_cast<unsigned>(rc);
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error("io_uring_enter: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+
+    // Calls f(user_data, res) for every available completion and releases them to the kernel.
+    template <typename Function>
+    unsigned for_each_cqe(Function&& f) {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            uint64_t userData = cqe.user_data;
+            int res = cqe.res;
+            // Release the slot before running the handler so it can queue new work freely.
+            __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+            f(userData, res);
+        }
+        return count;
+    }
+
+    uint64_t enter_calls() const {
+        return enterCalls_;
+    }
+
+private:
+    void* map(std::size_t bytes, uint64_t offset) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("io_uring mmap: " + std::string(std::strerror(errno)));
+        }
+        return p;
+    }
+
+    int fd_ = -1;
+    void* ring_ = nullptr;
+    std::size_t ringBytes_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqeBytes_ = 0;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned localTail_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    uint64_t enterCalls_ = 0;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+//
+// Jitter buffer configuration.
+// targetMs is the minimum depth the buffer fills to before playout starts (0 disables buffering);
+// maxMs bounds the depth, once it is reached the session stops reading and lets TCP push back.
+//
+struct jitter_buffer_config {
+    int targetMs = 0;
+    int maxMs = 200;
+
+    bool enabled() const { return targetMs > 0; }
+};
+
+//
+// Adaptive jitter buffer: reassembles a byte stream into fixed-size frames and holds them in a
+// preallocated ring until they are played out on a steady clock.
+// The playout target grows with the measured inter-arrival jitter (RFC 3550 style estimator) and
+// never drops below the configured depth. Frames are never dropped or concealed, so the output
+// always carries exactly the samples the client sent.
+//
+class jitter_buffer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    jitter_buffer(std::size_t frameBytes, std::chrono::milliseconds frameDuration, const jitter_buffer_config& cfg)
+        : frameBytes_(frameBytes),
+          frameDuration_(frameDuration),
+          minTarget_(frames_for(cfg.targetMs)),
+          capacity_(std::max(frames_for(cfg.maxMs), minTarget_ + 1)),
+          target_(minTarget_),
+          storage_(capacity_ * frameBytes_),
+          partial_(frameBytes_)
+    {
+    }
+
+    // Appends received bytes; every completed frame is queued with its arrival time.
+    // Returns the number of bytes consumed, which is less than len only when the ring is full.
+    std::size_t push(const char* data, std::size_t len, clock::time_point now) {
+        std::size_t consumed = 0;
+        while (consumed < len && !full()) {
+            std::size_t n = std::min(len - consumed, frameBytes_ - partialBytes_);
+            std::memcpy(partial_.data() + partialBytes_, data + consumed, n);
+            partialBytes_ += n;
+            consumed += n;
+            if (partialBytes_ == frameBytes_) {
+                enqueue_partial();
+                on_arrival(now);
+            }
+        }
+        return consumed;
+    }
+
+    // End of stream: zero-pads a trailing partial frame so it is played out instead of lost.
+    // Returns false if the ring is full and the flush must be retried after the next pop.
+    bool flush() {
+        if (partialBytes_ > 0) {
+            if (full())
+                return false;
+            std::memset(partial_.data() + partialBytes_, 0, frameBytes_ - partialBytes_);
+            ++paddedFrames_;
+            enqueue_partial();
+        }
+        endOfStream_ = true;
+        return true;
+    }
+
+    // Returns true when the buffer may release a frame this tick. Playout starts once the
+    // adaptive target depth is reached and pauses again (re-priming) after an underrun.
+    bool ready() {
+        if (playing_) {
+            if (count_ > 0 || endOfStream_)
+                return count_ > 0;
+            playing_ = false;
+            ++underruns_;
+            // An underrun means the target was too shallow for this client; buffer one more frame.
+            target_ = std::min(target_ + 1, capacity_ - 1);
+            return false;
+        }
+        if (count_ >= target_ || (endOfStream_ && count_ > 0)) {
+            playing_ = true;
+            return true;
+        }
+        return false;
+    }
+
+    // Number of frames to release this tick: one normally, two while draining excess depth
+    // left behind by a burst so that latency returns to the target.
+    std::size_t frames_due() const {
+        if (count_ == 0)
+            return 0;
+        return (count_ > target_ + 1) ? std::min<std::size_t>(2, count_) : 1;
+    }
+
+    const char* front() const { return storage_.data() + head_ * frameBytes_; }
+
+    void pop() {
+        head_ = (head_ + 1) % capacity_;
+        --count_;
+    }
+
+    bool full() const { return count_ == capacity_; }
+    bool empty() const { return count_ == 0; }
+    bool end_of_stream() const { return endOfStream_; }
+    bool drained() const { return endOfStream_ && count_ == 0; }
+
+    std::size_t depth() const { return count_; }
+    std::size_t target() const { return target_; }
+    std::size_t max_depth() const { return maxDepth_; }
+    std::size_t underruns() const { return underruns_; }
+    std::size_t padded_frames() const { return paddedFrames_; }
+    double jitter_ms() const { return jitterMs_; }
+
+private:
+    static constexpr std::size_t settle_frames = 50;
+
+    std::size_t frames_for(int ms) const {
+        auto frameMs = static_cast<int>(frameDuration_.count());
+        return ms <= 0 ? 1 : static_cast<std::size_t>((ms + frameMs - 1) / frameMs);
+    }
+
+    void enqueue_partial() {
+        std::size_t tail = (head_ + count_) % capacity_;
+        std::memcpy(storage_.data() + tail * frameBytes_, partial_.data(), frameBytes_);
+        partialBytes_ = 0;
+        ++count_;
+        maxDepth_ = std::max(maxDepth_, count_);
+    }
+
+    void on_arrival(clock::time_point now) {
+        if (haveLastArrival_) {
+            double delta = std::chrono::duration<double, std::milli>(now - lastArrival_).count();
+            double deviation = delta - static_cast<double>(frameDuration_.count());
+            jitterMs_ += (std::abs(deviation) - jitterMs_) / 16.0;
+            // Hold roughly twice the measured jitter. Grow immediately, but only shrink after the
+            // jitter has stayed low for a second so the depth does not oscillate.
+            auto desired = std::clamp(
+                static_cast<std::size_t>(std::ceil(2.0 * jitterMs_ / static_cast<double>(frameDuration_.count()))),
+                minTarget_, capacity_ - 1);
+            if (desired > target_) {
+                target_ = desired;
+                settledFrames_ = 0;
+            } else if (desired < target_ && ++settledFrames_ >= settle_frames) {
+                --target_;
+                settledFrames_ = 0;
+            }
+        }
+        lastArrival_ = now;
+        haveLastArrival_ = true;
+    }
+
+    std::size_t frameBytes_;
+    std::chrono::milliseconds frameDuration_;
+    std::size_t minTarget_;
+    std::size_t capacity_;
+    std::size_t target_;
+
+    std::vector<char> storage_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+
+    std::vector<char> partial_;
+    std::size_t partialBytes_ = 0;
+
+    bool playing_ = false;
+    bool endOfStream_ = false;
+
+    clock::time_point lastArrival_;
+    bool haveLastArrival_ = false;
+    double jitterMs_ = 0.0;
+    std::size_t settledFrames_ = 0;
+
+    std::size_t maxDepth_ = 0;
+    std::size_t underruns_ = 0;
+    std::size_t paddedFrames_ = 0;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <iostream>
+#include <mutex>
+#include <string>
+
+// --- Logging Utility ---
+inline std::mutex log_mutex;
+inline void log_info(const std::string& msg) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << "[INFO] " << msg << std::endl;
+}
+inline void log_error(const std::string& msg) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cerr << "[ERROR] " << msg << std::endl;
+}
@@ -5,8 +5,7 @@
 #include <vector>
 #include <thread>
 #include <cstdlib>
-#include <locale>
-#include <codecvt>
+#include <cstring>
 #include <mutex>
 #include <atomic>
 #include <csignal>
@@ -18,27 +17,35 @@
 #include <krisp-audio-sdk.hpp>
 #include <krisp-audio-sdk-nc.hpp>
 
+#include "admin_server.hpp"
+#include "admission.hpp"
+#include "alloc_counter.hpp"
+#include "audio_tap.hpp"
+#include "drain_control.hpp"
+#include "logging.hpp"
+#include "frame_scheduler.hpp"
+#include "frame_trace.hpp"
+#include "front_end.hpp"
+#include "handler_memory.hpp"
+#include "jitter_buffer.hpp"
+#include "nc_pipeline.hpp"
+#include "peer_name.hpp"
+#include "rtp_server.hpp"
+#include "session_control.hpp"
+#include "session_park.hpp"
+#include "slab_pool.hpp"
+#include "stream_message.hpp"
+#include "uring_server.hpp"
+#include "usage_accounting.hpp"
+#include "ws_session.hpp"
+#include "shm_session.hpp"
+
 using Krisp::AudioSdk::globalInit;
 using Krisp::AudioSdk::globalDestroy;
-using Krisp::AudioSdk::NcSessionConfig;
-using Krisp::AudioSdk::Nc;
-using Krisp::AudioSdk::ModelInfo;
-using Krisp::AudioSdk::FrameDuration;
 using Krisp::AudioSdk::SamplingRate;
-using Krisp::AudioSdk::SessionStats;
 
 using boost::asio::ip::tcp;
-
-// --- Logging Utility ---
-std::mutex log_mutex;
-void log_info(const std::string& msg) {
-    std::lock_guard<std::mutex> lock(log_mutex);
-    std::cout << "[INFO] " << msg << std::endl;
-}
-void log_error(const std::string& msg) {
-    std::lock_guard<std::mutex> lock(log_mutex);
-    std::cerr << "[ERROR] " << msg << std::endl;
-}
+using unix_socket = boost::asio::local::stream_protocol;
 
 // Constants for 16 kHz PCM16.
 // Each 20-ms chunk contains 320 samples (640 bytes).
@@ -46,74 +53,585 @@ static constexpr size_t sample_rate = 16000;
 static constexpr size_t samples_per_20ms = sample_rate * 20 / 1000;    // 320 samples
 static constexpr size_t bytes_per_sample = sizeof(int16_t);         // 2 bytes
 static constexpr size_t buffer_size = samples_per_20ms * bytes_per_sample; // 640 bytes
+static constexpr std::chrono::milliseconds frame_duration(20);
+// With a jitter buffer, up to two frames are written per playout tick while draining a burst.
+static constexpr size_t max_frames_per_tick = 2;
 
 //
-// Session class: handles a single TCP connection.
+// Session class: handles a single stream connection (TCP or Unix domain socket).
 // Each session creates its own Krisp session and processes incoming 20-ms audio chunks.
+// Without a jitter buffer, each chunk is processed and written back as soon as it is read.
+// With a jitter buffer, reads only fill the buffer and a 20-ms playout timer on the session's
+// strand processes and writes the frames, so bursty input leaves the server as steady output.
+//
+// The per-frame path does not touch the heap: every chain of operations (read, write, playout
+// timer) allocates its operation state from its own handler_memory block, and the single owning
+// reference to the session is moved from each completion handler into the next operation
+// instead of being copied, so there is no reference-count traffic per frame either.
+//
+// With a batching window configured, the direct path hands each frame to the shared
+// frame_scheduler instead of processing it inline, and writes it once the batch has run.
+//
+// A client that asked for framing in its handshake (framed=1) exchanges stream_message messages
+// instead of plain PCM: it sends its audio in messages and may send session_control commands
+// between them (see session_control::stream_demux), and gets its output audio as messages with
+// the command replies in between. Commands are applied on the strand between frames. Control
+// messages queued while no audio write is in flight go out on their own; otherwise they ride
+// ahead of the next audio message.
+//
+// When the server drains, a framed client gets drain_notice_text as a control message and can
+// reconnect elsewhere; a plain PCM stream has no channel for it and only sees the close at the
+// drain timeout. The stream itself keeps running until the client closes it or the drain times
+// out.
+//
+// For a frame sampled by the frame_tracer, the direct path records where the frame spent its
+// time: "read" (read issued until its handler runs on the strand, so it includes waiting for the
+// client), "batch" (queued in the frame_scheduler until its batch finished), "strand" (from
+// there until the write-back handler runs) and "write"; nc_pipeline adds "process".
+//
+// A client may start the stream with a handshake line naming its tenant and call (see
+// read_handshake); the session's usage is then billed to that tenant. Every handler runs
+// metered, so the time the session spends outside processing is billed as its I/O time.
 //
-class session : public std::enable_shared_from_this<session> {
+// The pipeline is opened once the handshake is read, so a stream that resumes (resume=TOKEN)
+// takes its parked pipeline from the session_park instead of instantiating the model again.
+// A stream that asked for resume gets one line back before any audio,
+// "APM/1 resume=TOKEN frames=N warm=0|1\n", and is parked under its token when the connection
+// drops, for as long as the server is not draining. If the client reconnects while this
+// connection still looks alive, the new session takes the stream over: this one is closed and
+// its pipeline handed across (see session_park).
+//
+template <typename Socket>
+class basic_session : public std::enable_shared_from_this<basic_session<Socket>>, private batch_client,
+                      private drain_listener, private session_park::resumable_stream {
 public:
-    session(tcp::socket socket, const std::string& model_path, float noiseSuppressionLevel, std::atomic<int>& activeCount, std::atomic<int>& totalCount)
+    basic_session(Socket socket, const std::string& model_path, float noiseSuppressionLevel,
+                  const jitter_buffer_config& jitterCfg, frame_scheduler& scheduler, drain_control& drain,
+                  admission_control& admission, tap_writer& taps, session_park& park, std::atomic<int>& totalCount)
         : socket_(std::move(socket)),
-          strand_(boost::asio::make_strand(socket_.get_executor())),
+          strand_(make_session_strand(socket_.get_executor())),
+          playoutTimer_(socket_.get_executor()),
+          modelPath_(model_path),
           noiseSuppressionLevel_(noiseSuppressionLevel),
-          connectionCount_(activeCount),
+          taps_(taps),
+          scheduler_(scheduler),
+          drain_(drain),
+          park_(park),
+          slot_(admission),
           totalConnections_(totalCount)
     {
-        try {
-            remoteAddress_ = socket_.remote_endpoint().address().to_string();
-        } catch (std::exception&) {
-            remoteAddress_ = "unknown";
-        }
-        // Increase active connection count.
-        ++connectionCount_;
+        remoteAddress_ = peer_name(socket_);
+        // The server reserved this session's slot before constructing it.
         log_info("New connection accepted from " + remoteAddress_ +
-                 " | Active: " + std::to_string(connectionCount_.load()) +
+                 " | Active: " + std::to_string(slot_.active()) +
                  " | Total: " + std::to_string(totalConnections_.load()));
 
-        // Create a dedicated Krisp session for this connection.
-        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-        ModelInfo ncModelInfo;
-        ncModelInfo.path = converter.from_bytes(model_path);
-
-        NcSessionConfig ncCfg{
-            SamplingRate::Sr16000Hz,   // Input sampling rate
-            FrameDuration::Fd20ms,      // Processing frame duration (20ms)
-            SamplingRate::Sr16000Hz,    // Output sampling rate (same as input)
-            &ncModelInfo,              // Model info
-            true,                     // Disable per-frame stats (enable if needed)
-            nullptr                    // No ringtone config
-        };
-
-        ncSession_ = Nc<int16_t>::create(ncCfg);
+        if (jitterCfg.enabled()) {
+            jitter_ = std::make_unique<jitter_buffer>(buffer_size, frame_duration, jitterCfg);
+        } else if (scheduler_.enabled()) {
+            batched_ = true;
+            scheduler_.attach();
+        }
+        drain_.join(*this);
     }
 
-    ~session() {
-        --connectionCount_;
+    ~basic_session() {
+        if (batched_) {
+            scheduler_.detach();
+        }
+        slot_.release();
         log_info("Connection closed from " + remoteAddress_ +
-                 " | Active: " + std::to_string(connectionCount_.load()) +
+                 " | Active: " + std::to_string(slot_.active()) +
                  " | Total: " + std::to_string(totalConnections_.load()));
 
-        printNcStats();
+        if (ncSession_ && (resumeToken_.empty() || !park_.park(resumeToken_, ncSession_))) {
+            ncSession_->print_stats();
+        }
+        if (!resumeToken_.empty()) {
+            park_.detach_live(resumeToken_, *this);
+        }
+        if (jitter_) {
+            printJitterStats();
+        }
+#ifdef APM_COUNT_ALLOCATIONS
+        log_info("Steady-state heap allocations (" + remoteAddress_ + "): " +
+                 std::to_string(probe_.steady_allocations()) + " over " +
+                 std::to_string(probe_.steady_frames()) + " frames");
+#endif
         ncSession_.reset();
+        drain_.leave(*this);
     }
 
     void start() {
-        do_read();
+        do_handshake(this->shared_from_this());
     }
 
 private:
-    void do_read() {
-        auto self(shared_from_this());
+    using self_ptr = std::shared_ptr<basic_session>;
+
+    // Binds a completion handler to the session's strand and to one of its handler_memory blocks,
+    // and bills its run time to the session's usage.
+    template <typename Handler>
+    auto wrap(handler_memory& memory, Handler handler) {
+        return boost::asio::bind_executor(strand_,
+            make_custom_alloc_handler(memory, metered(ncSession_->usage(), std::move(handler))));
+    }
+
+    // Reads the start of the stream until it is known whether it begins with a handshake line;
+    // a client that asked for resume may wait for the reply before it sends audio. The pipeline
+    // does not exist yet, so this read is not metered.
+    void do_handshake(self_ptr self, std::size_t filled = 0) {
+        socket_.async_read_some(boost::asio::buffer(read_buffer_.data() + filled, buffer_size - filled),
+            boost::asio::bind_executor(strand_, make_custom_alloc_handler(readMemory_,
+                [this, self = std::move(self), filled](boost::system::error_code ec, std::size_t n) mutable {
+                    filled += n;
+                    bool ended = ec == boost::asio::error::eof;
+                    if (ec && !(ended && filled > 0)) {
+                        if (ended || ec == boost::asio::error::connection_reset) {
+                            log_info("Client disconnected: " + remoteAddress_);
+                        } else if (ec != boost::asio::error::operation_aborted) {
+                            log_error("Read error (" + remoteAddress_ + "): " + ec.message());
+                        }
+                        socket_.close();
+                        return;
+                    }
+                    stream_identity identity;
+                    long header = read_handshake(read_buffer_.data(), filled, identity);
+                    if (header == handshake_incomplete && !ended && filled < buffer_size) {
+                        do_handshake(std::move(self), filled);
+                        return;
+                    }
+                    if (header < 0) {
+                        log_error("Malformed handshake from " + remoteAddress_);
+                        socket_.close();
+                        return;
+                    }
+                    framed_ = identity.framed;
+                    // Keep the audio that followed the handshake.
+                    std::size_t rest = filled - static_cast<std::size_t>(header);
+                    std::memmove(read_buffer_.data(), read_buffer_.data() + header, rest);
+
+                    bool resuming = !identity.resume.empty() && identity.resume != "new";
+                    std::unique_ptr<nc_pipeline> parked;
+                    if (resuming && park_.enabled()) {
+                        parked = park_.take(identity.resume, identity.tenant);
+                        if (!parked && take_over(self, identity, header > 0, rest, ended)) {
+                            return;
+                        }
+                    }
+                    open_stream(std::move(self), identity, header > 0, std::move(parked), rest, ended);
+                }
+            ))
+        );
+    }
+
+    // Takes over the stream holding the resume token while its old connection is still open;
+    // the stream opens once that connection has ended and handed its pipeline over. Returns
+    // false when there is no such stream.
+    bool take_over(const self_ptr& self, const stream_identity& identity, bool handshake, std::size_t rest, bool ended) {
+        return park_.take_over(identity.resume, identity.tenant,
+            [this, self, identity, handshake, rest, ended](std::unique_ptr<nc_pipeline> pipeline) {
+                auto handed = std::make_shared<std::unique_ptr<nc_pipeline>>(std::move(pipeline));
+                boost::asio::post(strand_, [this, self, identity, handshake, rest, ended, handed]() {
+                    if (socket_.is_open()) {
+                        open_stream(self, identity, handshake, std::move(*handed), rest, ended);
+                    } else if (*handed && !park_.park(identity.resume, *handed)) {
+                        (*handed)->print_stats();
+                    }
+                });
+            });
+    }
+
+    void open_stream(self_ptr self, const stream_identity& identity, bool handshake,
+                     std::unique_ptr<nc_pipeline> parked, std::size_t rest, bool ended) {
+        if (!open_pipeline(identity, handshake, std::move(parked))) {
+            socket_.close();
+            return;
+        }
+        if (!resumeToken_.empty()) {
+            park_.attach_live(resumeToken_, identity.tenant, *this);
+        }
+        start_stream(std::move(self), rest, ended);
+    }
+
+    // Creates the stream's pipeline unless it resumes with a parked one, and answers a resume
+    // request. Returns false (logged) when the stream cannot start.
+    bool open_pipeline(const stream_identity& identity, bool handshake, std::unique_ptr<nc_pipeline> parked) {
+        ncSession_ = std::move(parked);
+        bool warm = ncSession_ != nullptr;
+        if (!warm) {
+            try {
+                ncSession_ = std::make_unique<nc_pipeline>(modelPath_, SamplingRate::Sr16000Hz, noiseSuppressionLevel_);
+            } catch (std::exception& e) {
+                log_error("Could not create NC session (" + remoteAddress_ + "): " + e.what());
+                return false;
+            }
+            ncSession_->attach_tap(taps_, remoteAddress_);
+            if (handshake) {
+                ncSession_->usage().identify(identity);
+            }
+        }
+        if (handshake) {
+            log_info("Tenant " + identity.tenant + (identity.call.empty() ? "" : ", call " + identity.call) +
+                     ": " + remoteAddress_);
+        }
+        if (identity.resume.empty()) {
+            return true;
+        }
+
+        // A warm stream keeps its token; without resume on this server the answer is "off".
+        resumeToken_ = !park_.enabled() ? std::string() : warm ? identity.resume : park_.issue_token();
+        std::string reply = std::string(handshake_prefix) + "resume=" + (resumeToken_.empty() ? "off" : resumeToken_) +
+                            " frames=" + std::to_string(ncSession_->frames()) + " warm=" + (warm ? "1" : "0") + "\n";
+        // A few bytes on a fresh connection; the send buffer takes them without waiting.
+        boost::system::error_code ec;
+        boost::asio::write(socket_, boost::asio::buffer(reply), ec);
+        if (ec) {
+            log_error("Resume reply failed (" + remoteAddress_ + "): " + ec.message());
+            return false;
+        }
+        return true;
+    }
+
+    // Starts the audio path, with the first rest bytes of the stream already in read_buffer_;
+    // ended means the client has already finished sending.
+    void start_stream(self_ptr self, std::size_t rest, bool ended) {
+        if (framed_ && drain_.draining()) {
+            send_drain_notice();
+        }
+        if (framed_) {
+            // Those bytes are messages; keep them in the demux and start from their audio.
+            demux_.load(read_buffer_.data(), rest);
+            rest = take_audio(read_buffer_.data(), buffer_size);
+            if (!socket_.is_open()) {
+                return;
+            }
+        }
+        if (jitter_) {
+            pendingBytes_ = rest;
+            pendingOffset_ = 0;
+            nextPlayout_ = std::chrono::steady_clock::now();
+            if (ended) {
+                buffer_pending();
+                receiveEnded_ = true;
+                jitter_->flush();
+            } else if (buffer_pending()) {
+                do_receive(self);
+            }
+            schedule_playout(std::move(self));
+        } else if (ended) {
+            if (rest == 0) {
+                log_info("Client disconnected: " + remoteAddress_);
+                socket_.close();
+                return;
+            }
+            std::fill(read_buffer_.begin() + static_cast<std::ptrdiff_t>(rest), read_buffer_.end(), 0);
+            receiveEnded_ = true;
+            process_chunk(std::move(self));
+        } else {
+            do_read(std::move(self), rest);
+        }
+    }
+
+    // Reads the rest of a frame whose first offset bytes are already in read_buffer_.
+    void do_read(self_ptr self, std::size_t offset = 0) {
+        traced_ = ncSession_->trace_next();
+        if (traced_) {
+            traceSeq_ = ncSession_->frames();
+            traceBegin_ = std::chrono::steady_clock::now();
+        }
+        if (framed_) {
+            do_read_framed(std::move(self), offset);
+            return;
+        }
         boost::asio::async_read(socket_,
-            boost::asio::buffer(read_buffer_),
-            boost::asio::transfer_exactly(buffer_size),
-            boost::asio::bind_executor(strand_,
-                [this, self](boost::system::error_code ec, std::size_t bytes_transferred) {
+            boost::asio::buffer(read_buffer_.data() + offset, buffer_size - offset),
+            boost::asio::transfer_exactly(buffer_size - offset),
+            wrap(readMemory_,
+                [this, self = std::move(self), offset](boost::system::error_code ec, std::size_t bytes_transferred) mutable {
+                    trace_step("read");
+                    std::size_t filled = offset + bytes_transferred;
                     if (!ec) {
-                        process_chunk();
+                        process_chunk(std::move(self));
                     } else {
-                        if (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset) {
+                        read_ended(std::move(self), ec, filled);
+                    }
+                }
+            )
+        );
+    }
+
+    // Framed input: fills read_buffer_ from offset with the audio of the received messages,
+    // applying the commands between them, and reads more until a frame is complete.
+    void do_read_framed(self_ptr self, std::size_t offset) {
+        offset += take_audio(read_buffer_.data() + offset, buffer_size - offset);
+        if (!socket_.is_open()) {
+            return;
+        }
+        if (offset == buffer_size) {
+            trace_step("read");
+            process_chunk(std::move(self));
+            return;
+        }
+        socket_.async_read_some(boost::asio::buffer(demux_.space(), demux_.space_size()),
+            wrap(readMemory_,
+                [this, self = std::move(self), offset](boost::system::error_code ec, std::size_t n) mutable {
+                    if (!ec) {
+                        demux_.commit(n);
+                        do_read_framed(std::move(self), offset);
+                    } else {
+                        trace_step("read");
+                        read_ended(std::move(self), ec, offset);
+                    }
+                }
+            )
+        );
+    }
+
+    // A read of the direct path failed with filled bytes of the frame in read_buffer_.
+    void read_ended(self_ptr self, boost::system::error_code ec, std::size_t filled) {
+        if (ec == boost::asio::error::eof && filled > 0) {
+            // The client ended mid-frame: zero-pad and process the trailing samples instead of
+            // dropping them, then close once they are written.
+            std::fill(read_buffer_.begin() + static_cast<std::ptrdiff_t>(filled), read_buffer_.end(), 0);
+            receiveEnded_ = true;
+            process_chunk(std::move(self));
+            return;
+        }
+        if (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset) {
+            log_info("Client disconnected: " + remoteAddress_);
+        } else if (ec == boost::asio::error::operation_aborted) {
+            log_info("Connection closed at drain timeout: " + remoteAddress_);
+        } else {
+            log_error("Read error (" + remoteAddress_ + "): " + ec.message());
+        }
+        socket_.close();
+    }
+
+    // Moves the audio of the received messages into out and applies the commands before it.
+    // Closes the socket when the client breaks the framing.
+    std::size_t take_audio(char* out, std::size_t size) {
+        std::size_t n = demux_.take_audio(out, size, [this](const std::string& command) {
+            send_control(session_control::apply(*ncSession_, command));
+        });
+        if (demux_.failed()) {
+            log_error("Malformed framed input from " + remoteAddress_);
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        }
+        return n;
+    }
+
+    void printJitterStats()
+    {
+        log_info("#--- Jitter buffer stats (" + remoteAddress_ + ") ---" +
+            "\n# - Target depth: " + std::to_string(jitter_->target()) + " frames" +
+            "\n# - Max depth: " + std::to_string(jitter_->max_depth()) + " frames" +
+            "\n# - Jitter: " + std::to_string(jitter_->jitter_ms()) + " ms" +
+            "\n# - Underruns: " + std::to_string(jitter_->underruns()) +
+            "\n# - Padded frames: " + std::to_string(jitter_->padded_frames())
+        );
+    }
+
+    void process_frame(const char* in, char* out) {
+        const int16_t* in_samples = reinterpret_cast<const int16_t*>(in);
+        int16_t* out_samples = reinterpret_cast<int16_t*>(out);
+
+        ncSession_->process(in_samples, out_samples);
+        probe_.on_frame();
+    }
+
+    void process_chunk(self_ptr self) {
+        if (batched_) {
+            // The scheduler's completion resumes the chain, so it keeps the owning reference.
+            batchedSelf_ = std::move(self);
+            trace_step(nullptr);
+            scheduler_.submit(*this, *ncSession_, reinterpret_cast<const int16_t*>(read_buffer_.data()),
+                              reinterpret_cast<int16_t*>(write_buffer_.data()));
+            return;
+        }
+        process_frame(read_buffer_.data(), write_buffer_.data());
+        do_write(std::move(self));
+    }
+
+    void on_frame_processed() override {
+        trace_step("batch");
+        boost::asio::post(wrap(writeMemory_,
+            [this]() {
+                trace_step("strand");
+                probe_.on_frame();
+                do_write(std::move(batchedSelf_));
+            }
+        ));
+    }
+
+    void on_drain() override {
+        auto self = this->weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        // Before the handshake is read it is not known whether the stream is framed;
+        // start_stream() sends the notice then.
+        boost::asio::post(strand_, [this, self]() {
+            if (socket_.is_open() && ncSession_ && framed_) {
+                send_drain_notice();
+            }
+        });
+    }
+
+    void send_drain_notice() {
+        if (!drainNoticeSent_) {
+            drainNoticeSent_ = true;
+            send_control(drain_notice_text);
+        }
+    }
+
+    // Queues a control message for a framed client.
+    void send_control(const std::string& json) {
+        controlOut_ += stream_message::control_message(json);
+        if (!writing_ && !controlWriting_) {
+            write_control();
+        }
+    }
+
+    // Writes the queued control messages while no audio write is in flight. An audio write that
+    // comes up meanwhile waits for it (see do_write); the playout tick skips its turn.
+    void write_control() {
+        controlWriting_ = true;
+        controlSending_.swap(controlOut_);
+        boost::asio::async_write(socket_, boost::asio::buffer(controlSending_),
+            wrap(controlMemory_,
+                [this, self = this->shared_from_this()](boost::system::error_code ec, std::size_t) {
+                    controlWriting_ = false;
+                    controlSending_.clear();
+                    if (ec) {
+                        if (ec != boost::asio::error::operation_aborted) {
+                            log_error("Write error (" + remoteAddress_ + "): " + ec.message());
+                        }
+                        socket_.close();
+                        return;
+                    }
+                    if (writeWaiter_) {
+                        do_write(std::move(writeWaiter_));
+                    } else if (!controlOut_.empty() && !writing_) {
+                        write_control();
+                    }
+                }
+            )
+        );
+    }
+
+    // The output buffers of one audio write: queued control messages, then for a framed stream
+    // the audio message header, then the audio.
+    std::array<boost::asio::const_buffer, 3> output_buffers(std::size_t bytes) {
+        if (!framed_) {
+            return {boost::asio::const_buffer(), boost::asio::const_buffer(),
+                    boost::asio::buffer(write_buffer_.data(), bytes)};
+        }
+        controlSending_.swap(controlOut_);
+        stream_message::write_header(audioHeader_.data(), stream_message::audio, bytes);
+        return {boost::asio::buffer(controlSending_), boost::asio::buffer(audioHeader_),
+                boost::asio::buffer(write_buffer_.data(), bytes)};
+    }
+
+    void on_taken_over() override {
+        auto self = this->weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(strand_, [this, self]() {
+            log_info("Stream resumed on a new connection; closing " + remoteAddress_);
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        });
+    }
+
+    // Closing the socket completes the pending read or write with an error, which ends every
+    // chain; the playout chain stops on its next tick.
+    void on_drain_timeout() override {
+        auto self = this->weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(strand_, [this, self]() {
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        });
+    }
+
+    // Ends the current span of a traced frame (if name is set) and starts the next one.
+    void trace_step(const char* name) {
+        if (!traced_) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (name != nullptr) {
+            tracer().record(trace_span{name, ncSession_->trace_id(), traceSeq_, traceBegin_, now});
+        }
+        traceBegin_ = now;
+    }
+
+    void do_write(self_ptr self) {
+        trace_step(nullptr);
+        if (controlWriting_) {
+            writeWaiter_ = std::move(self);
+            return;
+        }
+        writing_ = true;
+        boost::asio::async_write(socket_, output_buffers(buffer_size),
+            wrap(writeMemory_,
+                [this, self = std::move(self)](boost::system::error_code ec, std::size_t) mutable {
+                    trace_step("write");
+                    writing_ = false;
+                    controlSending_.clear();
+                    if (!ec && receiveEnded_) {
+                        log_info("Client disconnected: " + remoteAddress_);
+                        socket_.close();
+                    } else if (!ec) {
+                        if (!controlOut_.empty()) {
+                            write_control();
+                        }
+                        do_read(std::move(self));
+                    } else {
+                        log_error("Write error (" + remoteAddress_ + "): " + ec.message());
+                        socket_.close();
+                    }
+                }
+            )
+        );
+    }
+
+    //
+    // Jitter-buffered path. All of these run on the session's strand.
+    //
+    void do_receive(self_ptr self) {
+        // Framed input is read into the demux; a read holds at most one frame's worth of bytes,
+        // so all of its audio fits in read_buffer_.
+        auto buffer = framed_ ? boost::asio::buffer(demux_.space(), demux_.space_size())
+                              : boost::asio::buffer(read_buffer_);
+        socket_.async_read_some(buffer,
+            wrap(readMemory_,
+                [this, self = std::move(self)](boost::system::error_code ec, std::size_t bytes_transferred) mutable {
+                    if (!ec && framed_) {
+                        demux_.commit(bytes_transferred);
+                        bytes_transferred = take_audio(read_buffer_.data(), buffer_size);
+                        if (!socket_.is_open()) {
+                            return;
+                        }
+                    }
+                    if (!ec) {
+                        pendingBytes_ = bytes_transferred;
+                        pendingOffset_ = 0;
+                        if (buffer_pending()) {
+                            do_receive(std::move(self));
+                        }
+                    } else if (ec == boost::asio::error::eof) {
+                        // Queue the padded partial frame (if any); the playout timer drains the rest.
+                        log_info("Client finished sending: " + remoteAddress_);
+                        receiveEnded_ = true;
+                        jitter_->flush();
+                    } else if (ec != boost::asio::error::operation_aborted) {
+                        if (ec == boost::asio::error::connection_reset) {
                             log_info("Client disconnected: " + remoteAddress_);
                         } else {
                             log_error("Read error (" + remoteAddress_ + "): " + ec.message());
@@ -125,70 +643,168 @@ private:
         );
     }
 
-    void printNcStats()
-    {
-        SessionStats ncSessionStats;
-        ncSession_->getSessionStats(&ncSessionStats);
-        log_info(std::string("#--- Session stats ---") +
-            "\n# - No Noise: " + std::to_string(ncSessionStats.noiseStats.noNoiseMs) + " ms" +
-            "\n# - Low Noise: " + std::to_string(ncSessionStats.noiseStats.lowNoiseMs) + " ms" +
-            "\n# - Medium Noise: " + std::to_string(ncSessionStats.noiseStats.mediumNoiseMs) + " ms" +
-            "\n# - High Noise: " + std::to_string(ncSessionStats.noiseStats.highNoiseMs) + " ms" +
-            "\n# - Talk Time: " + std::to_string(ncSessionStats.voiceStats.talkTimeMs) + " ms"
+    // Moves received bytes into the jitter buffer. Returns false (pausing reads) when the buffer
+    // is full, which leaves the remainder in read_buffer_ and lets TCP flow control slow the client.
+    bool buffer_pending() {
+        pendingOffset_ += jitter_->push(read_buffer_.data() + pendingOffset_, pendingBytes_ - pendingOffset_,
+                                        std::chrono::steady_clock::now());
+        receivePaused_ = pendingOffset_ < pendingBytes_;
+        return !receivePaused_;
+    }
+
+    void schedule_playout(self_ptr self) {
+        // Tick on absolute deadlines so the output cadence does not drift; after a stall, resume
+        // from now rather than firing a backlog of ticks.
+        auto now = std::chrono::steady_clock::now();
+        nextPlayout_ = std::max(nextPlayout_ + frame_duration, now - frame_duration);
+        playoutTimer_.expires_at(nextPlayout_);
+        playoutTimer_.async_wait(
+            wrap(timerMemory_,
+                [this, self = std::move(self)](boost::system::error_code ec) mutable {
+                    if (!ec) {
+                        on_playout_tick(std::move(self));
+                    }
+                }
+            )
         );
     }
 
-    void process_chunk() {
-        const int16_t* in_samples = reinterpret_cast<const int16_t*>(read_buffer_.data());
-        int16_t* out_samples = reinterpret_cast<int16_t*>(write_buffer_.data());
+    void on_playout_tick(self_ptr self) {
+        if (!socket_.is_open()) {
+            return;
+        }
+
+        if (!writing_ && !controlWriting_ && jitter_->ready()) {
+            std::size_t frames = jitter_->frames_due();
+            for (std::size_t i = 0; i < frames; ++i) {
+                process_frame(jitter_->front(), write_buffer_.data() + i * buffer_size);
+                jitter_->pop();
+            }
+            do_write_paced(frames * buffer_size);
+        }
+
+        if (receivePaused_ && buffer_pending()) {
+            // The receive chain ended when it paused; restart it with its own reference.
+            do_receive(self);
+        }
+        if (receiveEnded_ && !jitter_->end_of_stream()) {
+            jitter_->flush();
+        }
 
-        ncSession_->process(in_samples, samples_per_20ms,
-                            out_samples, samples_per_20ms,
-                            noiseSuppressionLevel_, nullptr);
-        do_write();
+        if (jitter_->drained() && !writing_ && !controlWriting_) {
+            boost::system::error_code ignored;
+            socket_.shutdown(Socket::shutdown_send, ignored);
+            socket_.close(ignored);
+            return;
+        }
+        schedule_playout(std::move(self));
     }
 
-    void do_write() {
-        auto self(shared_from_this());
-        boost::asio::async_write(socket_,
-            boost::asio::buffer(write_buffer_),
-            boost::asio::bind_executor(strand_,
-                [this, self](boost::system::error_code ec, std::size_t) {
-                    if (!ec) {
-                        do_read();
-                    } else {
+    // The paced write is not part of either chain, so it holds its own reference: the playout
+    // chain may stop (socket closed) while the write is still in flight.
+    void do_write_paced(std::size_t bytes) {
+        writing_ = true;
+        boost::asio::async_write(socket_, output_buffers(bytes),
+            wrap(writeMemory_,
+                [this, self = this->shared_from_this()](boost::system::error_code ec, std::size_t) {
+                    writing_ = false;
+                    controlSending_.clear();
+                    if (ec && ec != boost::asio::error::operation_aborted) {
                         log_error("Write error (" + remoteAddress_ + "): " + ec.message());
+                        socket_.close();
+                    } else if (!ec && !controlOut_.empty()) {
+                        write_control();
                     }
                 }
             )
         );
     }
 
-    tcp::socket socket_;
-    boost::asio::strand<boost::asio::any_io_executor> strand_;
+    Socket socket_;
+    session_strand strand_;
+    boost::asio::steady_timer playoutTimer_;
+    handler_memory readMemory_;
+    handler_memory writeMemory_;
+    handler_memory timerMemory_;
+    handler_memory controlMemory_;
     std::array<char, buffer_size> read_buffer_;
-    std::array<char, buffer_size> write_buffer_;
-    std::shared_ptr<Nc<int16_t>> ncSession_;
+    std::array<char, buffer_size * max_frames_per_tick> write_buffer_;
+    bool framed_ = false;           // input and output are stream_message messages (framed=1)
+    session_control::stream_demux<buffer_size> demux_;
+    std::array<char, stream_message::header_size> audioHeader_;
+    std::string controlOut_;        // control messages for the next write
+    std::string controlSending_;    // control messages of the write in flight
+    bool controlWriting_ = false;   // a write of control messages alone is in flight
+    bool drainNoticeSent_ = false;
+    self_ptr writeWaiter_;          // the direct chain, waiting for that write to finish
+    std::unique_ptr<nc_pipeline> ncSession_;     // opened once the handshake is read
+    std::unique_ptr<jitter_buffer> jitter_;
+    std::string modelPath_;
     float noiseSuppressionLevel_;
+    tap_writer& taps_;
+    frame_scheduler& scheduler_;
+    drain_control& drain_;
+    session_park& park_;
+    std::string resumeToken_;       // set when the stream is parked on disconnect
+    bool batched_ = false;
+    self_ptr batchedSelf_;
+    hot_path_probe probe_;
+    bool traced_ = false;           // the frame on the direct path is sampled for tracing
+    uint64_t traceSeq_ = 0;
+    std::chrono::steady_clock::time_point traceBegin_;
+    std::chrono::steady_clock::time_point nextPlayout_;
+    std::size_t pendingBytes_ = 0;
+    std::size_t pendingOffset_ = 0;
+    bool receivePaused_ = false;
+    bool receiveEnded_ = false;
+    bool writing_ = false;          // an audio write is in flight
     std::string remoteAddress_;
-    std::atomic<int>& connectionCount_;
+    admission_slot slot_;
     std::atomic<int>& totalConnections_;
 };
 
+using session = basic_session<tcp::socket>;
+using unix_session = basic_session<unix_socket::socket>;
+
+//
+// Additional listeners next to the main TCP port; empty / 0 disables each one.
+//
+struct listener_config {
+    short wsPort = 0;
+    std::string unixSocketPath;     // raw PCM stream sessions over a Unix domain socket
+    std::string shmSocketPath;      // control socket for shared-memory ring streams
+    std::chrono::microseconds batchWindow{0};   // cross-session batching window for stream sessions
+    int acceptQueue = 8;            // connections that may wait for a slot when all are in use
+    std::chrono::milliseconds acceptQueueTimeout{1000};
+    resume_config resume;           // parking of TCP and Unix-socket streams for resume
+};
+
 //
 // Server class: listens for incoming connections, enforces a maximum connection limit,
 // and creates a new session for each accepted connection.
+// Optional extra listeners (WebSocket, Unix socket, shared-memory control socket) create
+// ws_session, unix_session and shm_session objects; all listeners share the same connection
+// limit and counters.
+// Slots are reserved through admission_control before a session is constructed. A connection
+// arriving while the server is full waits in the accept queue, and is turned away with a busy
+// response if none frees up in time; the accept loops themselves never wait.
 // It also provides a shutdown() method to stop accepting new connections.
 //
 class server {
 public:
     server(boost::asio::io_context& io_context, short port, const std::string& model_path,
-           float noiseSuppressionLevel, int maxConnections)
+           float noiseSuppressionLevel, int maxConnections, const jitter_buffer_config& jitterCfg,
+           drain_control& drain, tap_writer& taps, const listener_config& listeners = {})
         : acceptor_(io_context, tcp::endpoint(tcp::v4(), static_cast<unsigned short>(port))),
+          drain_(drain),
+          taps_(taps),
           model_path_(model_path),
           noiseSuppressionLevel_(noiseSuppressionLevel),
-          maxConnections_(maxConnections),
-          activeConnections_(0),
+          jitterCfg_(jitterCfg),
+          scheduler_(io_context, listeners.batchWindow, static_cast<std::size_t>(maxConnections)),
+          admission_(io_context, maxConnections, static_cast<std::size_t>(listeners.acceptQueue),
+                     listeners.acceptQueueTimeout),
+          park_(io_context, listeners.resume),
           totalConnections_(0)
     {
         try {
@@ -198,6 +814,23 @@ public:
             log_error("Could not obtain local endpoint: " + std::string(e.what()));
         }
         do_accept();
+
+        if (listeners.wsPort > 0) {
+            wsAcceptor_ = std::make_unique<tcp::acceptor>(io_context, tcp::endpoint(tcp::v4(), static_cast<unsigned short>(listeners.wsPort)));
+            log_info("WebSocket listening on " + wsAcceptor_->local_endpoint().address().to_string() +
+                     ":" + std::to_string(wsAcceptor_->local_endpoint().port()));
+            do_accept_ws();
+        }
+        if (!listeners.unixSocketPath.empty()) {
+            unixAcceptor_ = open_unix_acceptor(io_context, listeners.unixSocketPath);
+            log_info("Unix socket listening on " + listeners.unixSocketPath);
+            do_accept_unix();
+        }
+        if (!listeners.shmSocketPath.empty()) {
+            shmAcceptor_ = open_unix_acceptor(io_context, listeners.shmSocketPath);
+            log_info("Shared-memory control socket listening on " + listeners.shmSocketPath);
+            do_accept_shm();
+        }
     }
 
     // Shutdown the server: close the acceptor so no new connections are accepted.
@@ -209,27 +842,129 @@ public:
         } else {
             log_info("Acceptor closed. No longer accepting new connections.");
         }
+        if (wsAcceptor_) {
+            wsAcceptor_->close(ec);
+            if (ec) {
+                log_error("Error closing WebSocket acceptor: " + ec.message());
+            }
+        }
+        close_unix_acceptor(unixAcceptor_);
+        close_unix_acceptor(shmAcceptor_);
+        admission_.close();
+        park_.close();
+
+        auto admission = admission_.get_stats();
+        log_info("Admission: " + std::to_string(admission.admitted) + " admitted | " +
+                 std::to_string(admission.queued) + " queued | " + std::to_string(admission.rejected) +
+                 " rejected | " + std::to_string(admission.timedOut) + " timed out in queue");
+        scheduler_.print_stats();
+        log_pool_stats("TCP session", slab_pool_for<session>());
+        log_pool_stats("WebSocket session", slab_pool_for<ws_session>());
+        log_pool_stats("Unix socket session", slab_pool_for<unix_session>());
+        log_pool_stats("Shared-memory session", slab_pool_for<shm_session>());
     }
 
     // Returns the current active connection count.
     int get_active_connections() const {
-        return activeConnections_.load();
+        return admission_.active();
+    }
+
+    admission_control::stats get_admission_stats() const {
+        return admission_.get_stats();
+    }
+
+    // Takes over a client connection that a front end accepted and passed on (see front_end.hpp),
+    // and admits it as if it had been accepted on the stream or WebSocket port. The session reads
+    // the connection from its first byte; the front end never reads from it.
+    void adopt(char kind, int fd) {
+        sockaddr_storage local{};
+        socklen_t length = sizeof(local);
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length);
+        tcp protocol = local.ss_family == AF_INET6 ? tcp::v6() : tcp::v4();
+        boost::system::error_code ec;
+        if (kind == handoff_websocket) {
+            tcp::socket socket(boost::asio::make_strand(acceptor_.get_executor()));
+            socket.assign(protocol, fd, ec);
+            if (!ec) {
+                admit_websocket(std::move(socket));
+                return;
+            }
+        } else {
+            tcp::socket socket(acceptor_.get_executor());
+            socket.assign(protocol, fd, ec);
+            if (!ec) {
+                admit_stream(std::move(socket));
+                return;
+            }
+        }
+        log_error("Could not take over handed-off connection: " + ec.message());
+        ::close(fd);
     }
 
 private:
+    // Sessions (with their inline frame buffers) come from a per-type slab pool instead of the
+    // general heap, so connect/disconnect churn reuses the same cache-aligned blocks.
+    template <typename Session, typename... Args>
+    static std::shared_ptr<Session> make_session(Args&&... args) {
+        return std::allocate_shared<Session>(slab_allocator<Session>(slab_pool_for<Session>()),
+                                             std::forward<Args>(args)...);
+    }
+
+    static void log_pool_stats(const std::string& name, slab_pool& pool) {
+        auto stats = pool.get_stats();
+        if (stats.slabs == 0) {
+            return;
+        }
+        log_info(name + " pool: " + std::to_string(stats.slabs) + " slab(s) of " +
+                 std::to_string(slab_pool::blocks_per_slab) + " x " + std::to_string(stats.blockSize) +
+                 " bytes | In use: " + std::to_string(stats.inUse) +
+                 " | Heap fallbacks: " + std::to_string(stats.heapFallbacks));
+    }
+
+    // Starts a session for an accepted connection once admission_control grants it a slot;
+    // refuse() sends the transport's busy response if it cannot get one.
+    template <typename Socket, typename Start, typename Refuse>
+    void admit(Socket socket, const std::string& kind, Start start, Refuse refuse) {
+        // std::function needs copyable callbacks, so the waiting socket is shared between them.
+        auto pending = std::make_shared<Socket>(std::move(socket));
+        admission_.admit(
+            [this, pending, kind, start]() {
+                ++totalConnections_;
+                try {
+                    start(std::move(*pending));
+                } catch (std::exception& e) {
+                    log_error("Could not start " + kind + " session: " + e.what());
+                }
+            },
+            [pending, kind, refuse]() {
+                log_error("Server busy. Rejecting " + kind + " from " + peer_name(*pending));
+                refuse(*pending);
+            }
+        );
+    }
+
+    void admit_stream(tcp::socket socket) {
+        admit(std::move(socket), "connection",
+            [this](tcp::socket s) {
+                make_session<session>(std::move(s), model_path_, noiseSuppressionLevel_, jitterCfg_, scheduler_, drain_, admission_, taps_, park_, totalConnections_)->start();
+            },
+            [](tcp::socket& s) { send_busy_notice(s); });
+    }
+
+    // The socket must have been created on its own strand (see do_accept_ws).
+    void admit_websocket(tcp::socket socket) {
+        admit(std::move(socket), "WebSocket connection",
+            [this](tcp::socket s) {
+                make_session<ws_session>(std::move(s), model_path_, noiseSuppressionLevel_, drain_, admission_, taps_, totalConnections_)->start();
+            },
+            [](tcp::socket& s) { ws_session::reject_busy(std::move(s)); });
+    }
+
     void do_accept() {
         acceptor_.async_accept(
             [this](boost::system::error_code ec, tcp::socket socket) {
                 if (!ec) {
-                    // Enforce maximum connection limit.
-                    if (activeConnections_ >= maxConnections_) {
-                        log_error("Max connections reached. Rejecting connection from " +
-                                  socket.remote_endpoint().address().to_string());
-                        socket.close();
-                    } else {
-                        ++totalConnections_;
-                        std::make_shared<session>(std::move(socket), model_path_, noiseSuppressionLevel_, activeConnections_, totalConnections_)->start();
-                    }
+                    admit_stream(std::move(socket));
                 } else {
                     log_error("Accept error: " + ec.message());
                 }
@@ -240,24 +975,230 @@ private:
         );
     }
 
+    void do_accept_ws() {
+        // Beast requires every operation on a stream to share one executor, so the socket is
+        // created on its own strand rather than binding handlers to a strand afterwards.
+        wsAcceptor_->async_accept(boost::asio::make_strand(wsAcceptor_->get_executor()),
+            [this](boost::system::error_code ec, tcp::socket socket) {
+                if (!ec) {
+                    admit_websocket(std::move(socket));
+                } else {
+                    log_error("WebSocket accept error: " + ec.message());
+                }
+                if (wsAcceptor_->is_open())
+                    do_accept_ws();
+            }
+        );
+    }
+
+    // Binds a Unix-socket acceptor, replacing a stale socket file left by a previous run.
+    static std::unique_ptr<unix_socket::acceptor> open_unix_acceptor(boost::asio::io_context& io_context, const std::string& path) {
+        ::unlink(path.c_str());
+        return std::make_unique<unix_socket::acceptor>(io_context, unix_socket::endpoint(path));
+    }
+
+    static void close_unix_acceptor(std::unique_ptr<unix_socket::acceptor>& acceptor) {
+        if (!acceptor || !acceptor->is_open()) {
+            return;
+        }
+        boost::system::error_code ec;
+        std::string path = acceptor->local_endpoint(ec).path();
+        acceptor->close(ec);
+        if (!path.empty()) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    void do_accept_unix() {
+        unixAcceptor_->async_accept(
+            [this](boost::system::error_code ec, unix_socket::socket socket) {
+                if (!ec) {
+                    admit(std::move(socket), "Unix socket connection",
+                        [this](unix_socket::socket s) {
+                            make_session<unix_session>(std::move(s), model_path_, noiseSuppressionLevel_, jitterCfg_, scheduler_, drain_, admission_, taps_, park_, totalConnections_)->start();
+                        },
+                        [](unix_socket::socket& s) { send_busy_notice(s); });
+                } else {
+                    log_error("Unix socket accept error: " + ec.message());
+                }
+                if (unixAcceptor_->is_open())
+                    do_accept_unix();
+            }
+        );
+    }
+
+    void do_accept_shm() {
+        shmAcceptor_->async_accept(
+            [this](boost::system::error_code ec, unix_socket::socket socket) {
+                if (!ec) {
+                    admit(std::move(socket), "shared-memory stream",
+                        [this](unix_socket::socket s) {
+                            make_session<shm_session>(std::move(s), model_path_, noiseSuppressionLevel_, drain_, admission_, taps_, totalConnections_)->start();
+                        },
+                        [](unix_socket::socket& s) { shm_session::reject_busy(s); });
+                } else {
+                    log_error("Shared-memory accept error: " + ec.message());
+                }
+                if (shmAcceptor_->is_open())
+                    do_accept_shm();
+            }
+        );
+    }
+
     tcp::acceptor acceptor_;
+    std::unique_ptr<tcp::acceptor> wsAcceptor_;
+    std::unique_ptr<unix_socket::acceptor> unixAcceptor_;
+    std::unique_ptr<unix_socket::acceptor> shmAcceptor_;
+    drain_control& drain_;
+    tap_writer& taps_;
     std::string model_path_;
     float noiseSuppressionLevel_;
-    int maxConnections_;
-    std::atomic<int> activeConnections_;
+    jitter_buffer_config jitterCfg_;
+    frame_scheduler scheduler_;
+    admission_control admission_;
+    session_park park_;
     std::atomic<int> totalConnections_;
 };
 
+//
+// Parses an optional "--name=value" argument. Returns true and sets value if arg matches name.
+//
+static bool parse_option(const std::string& arg, const std::string& name, std::string& value) {
+    std::string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+//
+// Front-end mode: no model and no streams of its own. Connections on the stream and WebSocket
+// ports are handed to the workers until SIGINT / SIGTERM; streams already handed off are the
+// workers' to drain.
+//
+static int run_front_end(const front_end_config& cfg) {
+    try {
+        boost::asio::io_context io_context;
+        front_end balancer(io_context, cfg);
+        boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&io_context, &balancer](boost::system::error_code /*ec*/, int signo) {
+            log_info("Shutdown signal (" + std::to_string(signo) + ") received. Stopping front end...");
+            balancer.shutdown();
+            io_context.stop();
+        });
+        io_context.run();
+    } catch (std::exception& e) {
+        log_error("Exception in front end: " + std::string(e.what()));
+        return 1;
+    }
+    return 0;
+}
+
 //
 // Main: Initializes the Krisp SDK, sets up signal handling for graceful shutdown,
 // creates the server, and runs the asynchronous server on a thread pool.
-// The graceful shutdown will wait for up to a configurable timeout (in seconds) for active
-// connections to close before forcing shutdown.
+// On SIGINT / SIGTERM the server drains: listeners close, connected clients get an in-band drain
+// notice, and the process exits as soon as the last stream ends, or after a configurable timeout
+// (in seconds) with streams still open.
 //
 int main(int argc, char* argv[]) {
-    // Usage: server <port> <model_path> [noise_suppression_level] [max_connections] [shutdown_timeout_sec]
-    if (argc < 3) {
-        std::cerr << "Usage: apm-krisp-nc <port> <model_path> [noise_suppression_level] [max_connections] [shutdown_timeout_sec]\n";
+    // Usage: server <port> <model_path> [noise_suppression_level] [max_connections] [shutdown_timeout_sec] [options]
+    // Options may appear anywhere on the command line; everything else is positional.
+    std::vector<std::string> args;
+    jitter_buffer_config jitterCfg;
+    rtp_config rtpCfg;
+    listener_config listeners;
+    int uringPort = 0;
+    int adminPort = 0;
+    std::string handoffSocketPath;
+    front_end_config frontEnd;
+    tap_config tapCfg;
+    trace_config traceCfg;
+    conditioning_mode conditioning = conditioning_mode::off;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
+        if (parse_option(arg, "jitter-buffer-ms", value)) {
+            jitterCfg.targetMs = std::atoi(value.c_str());
+        } else if (parse_option(arg, "jitter-buffer-max-ms", value)) {
+            jitterCfg.maxMs = std::atoi(value.c_str());
+        } else if (parse_option(arg, "ws-port", value)) {
+            listeners.wsPort = static_cast<short>(std::atoi(value.c_str()));
+        } else if (parse_option(arg, "unix-socket", value)) {
+            listeners.unixSocketPath = value;
+        } else if (parse_option(arg, "shm-socket", value)) {
+            listeners.shmSocketPath = value;
+        } else if (parse_option(arg, "batch-window-us", value)) {
+            listeners.batchWindow = std::chrono::microseconds(std::atoi(value.c_str()));
+        } else if (parse_option(arg, "accept-queue", value)) {
+            listeners.acceptQueue = std::max(0, std::atoi(value.c_str()));
+        } else if (parse_option(arg, "accept-queue-timeout-ms", value)) {
+            listeners.acceptQueueTimeout = std::chrono::milliseconds(std::atoi(value.c_str()));
+        } else if (parse_option(arg, "resume-grace-ms", value)) {
+            listeners.resume.grace = std::chrono::milliseconds(std::max(0, std::atoi(value.c_str())));
+        } else if (parse_option(arg, "resume-max-parked", value)) {
+            listeners.resume.maxParked = static_cast<std::size_t>(std::max(1, std::atoi(value.c_str())));
+        } else if (parse_option(arg, "handoff-socket", value)) {
+            handoffSocketPath = value;
+        } else if (parse_option(arg, "front-end", value)) {
+            std::size_t start = 0;
+            while (start <= value.size()) {
+                std::size_t end = std::min(value.find(',', start), value.size());
+                if (end > start) {
+                    frontEnd.workers.push_back(value.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+        } else if (parse_option(arg, "admin-port", value)) {
+            adminPort = std::atoi(value.c_str());
+        } else if (parse_option(arg, "tap-dir", value)) {
+            tapCfg.directory = value;
+        } else if (parse_option(arg, "tap-every", value)) {
+            tapCfg.every = static_cast<unsigned>(std::max(1, std::atoi(value.c_str())));
+        } else if (parse_option(arg, "tap-format", value)) {
+            if (value != "wav" && value != "raw") {
+                std::cerr << "Unknown tap format: " << value << " (expected wav or raw)\n";
+                return 1;
+            }
+            tapCfg.wav = value == "wav";
+        } else if (parse_option(arg, "conditioning", value)) {
+            if (!parse_conditioning_mode(value, conditioning)) {
+                std::cerr << "Unknown conditioning mode: " << value << " (expected off, measure or on)\n";
+                return 1;
+            }
+        } else if (parse_option(arg, "trace-every", value)) {
+            traceCfg.every = static_cast<unsigned>(std::max(0, std::atoi(value.c_str())));
+        } else if (parse_option(arg, "trace-file", value)) {
+            traceCfg.path = value;
+        } else if (parse_option(arg, "io-uring-port", value)) {
+            uringPort = std::atoi(value.c_str());
+        } else if (parse_option(arg, "rtp-port", value)) {
+            rtpCfg.port = std::atoi(value.c_str());
+        } else if (parse_option(arg, "rtp-l16-pt", value)) {
+            rtpCfg.l16PayloadType = std::atoi(value.c_str());
+        } else if (parse_option(arg, "rtp-reorder-window", value)) {
+            rtpCfg.reorderWindow = std::atoi(value.c_str());
+        } else if (parse_option(arg, "rtp-idle-timeout-ms", value)) {
+            rtpCfg.idleTimeoutMs = std::atoi(value.c_str());
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() < (frontEnd.workers.empty() ? 2u : 1u)) {
+        std::cerr << "Usage: apm-krisp-nc <port> <model_path> [noise_suppression_level] [max_connections] [shutdown_timeout_sec]\n"
+                     "                    [--jitter-buffer-ms=N] [--jitter-buffer-max-ms=N] [--batch-window-us=N]\n"
+                     "                    [--ws-port=N] [--unix-socket=PATH] [--shm-socket=PATH] [--io-uring-port=N]\n"
+                     "                    [--accept-queue=N] [--accept-queue-timeout-ms=N] [--admin-port=N]\n"
+                     "                    [--resume-grace-ms=N] [--resume-max-parked=N] [--handoff-socket=PATH]\n"
+                     "                    [--tap-dir=PATH] [--tap-every=N] [--tap-format=wav|raw]\n"
+                     "                    [--conditioning=off|measure|on] [--trace-every=N] [--trace-file=PATH]\n"
+                     "                    [--rtp-port=N] [--rtp-l16-pt=N] [--rtp-reorder-window=N] [--rtp-idle-timeout-ms=N]\n"
+                     "       apm-krisp-nc <port> --front-end=PATH[,PATH...] [--ws-port=N]\n";
         return 1;
     }
 
@@ -265,76 +1206,149 @@ int main(int argc, char* argv[]) {
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
 
-    short port = static_cast<short>(std::atoi(argv[1]));
-    std::string model_path = argv[2];
+    short port = static_cast<short>(std::atoi(args[0].c_str()));
+    if (!frontEnd.workers.empty()) {
+        frontEnd.port = static_cast<unsigned short>(port);
+        frontEnd.wsPort = static_cast<unsigned short>(listeners.wsPort);
+        return run_front_end(frontEnd);
+    }
+    std::string model_path = args[1];
     float noiseSuppressionLevel = 100.0f;
-    if (argc >= 4) {
-        noiseSuppressionLevel = std::stof(argv[3]);
+    if (args.size() >= 3) {
+        noiseSuppressionLevel = std::stof(args[2]);
     }
     int maxConnections = 10; // Default
-    if (argc >= 5) {
-        maxConnections = std::atoi(argv[4]);
+    if (args.size() >= 4) {
+        maxConnections = std::atoi(args[3].c_str());
     }
     int shutdownTimeoutSec = 120; // Default 60 seconds
-    if (argc >= 6) {
-        shutdownTimeoutSec = std::atoi(argv[5]);
+    if (args.size() >= 5) {
+        shutdownTimeoutSec = std::atoi(args[4].c_str());
+    }
+    tracer().configure(traceCfg);
+    nc_pipeline::default_conditioning() = conditioning;
+    if (conditioning != conditioning_mode::off) {
+        log_info(std::string("Input conditioning: ") + to_string(conditioning));
+    }
+    if (jitterCfg.enabled()) {
+        log_info("Jitter buffer enabled: target " + std::to_string(jitterCfg.targetMs) +
+                 " ms, max " + std::to_string(jitterCfg.maxMs) + " ms");
     }
 
     try {
         // Global Krisp initialization (call once at startup).
         globalInit(L"");
 
+        // Load the model once up front: a bad model path shows up at startup (and keeps the admin
+        // endpoint's readiness at 503) instead of on the first call.
+        std::atomic<bool> modelLoaded{false};
+        try {
+            nc_pipeline probe(model_path, SamplingRate::Sr16000Hz, noiseSuppressionLevel);
+            modelLoaded = true;
+            log_info("Model loaded: " + model_path);
+        } catch (std::exception& e) {
+            log_error("Could not load model " + model_path + ": " + e.what());
+        }
+
+        // Declared before the io_context: sessions destroyed along with it still leave() it, and
+        // their taps are finished once they are all gone.
+        tap_writer taps(tapCfg);
+        drain_control drain;
         boost::asio::io_context io_context;
 
         // Create the server.
-        server srv(io_context, port, model_path, noiseSuppressionLevel, maxConnections);
+        server srv(io_context, port, model_path, noiseSuppressionLevel, maxConnections, jitterCfg, drain, taps, listeners);
+
+        // Optional RTP listener; it allows up to max_connections streams and takes part in graceful shutdown.
+        std::unique_ptr<rtp_server> rtp;
+        if (rtpCfg.enabled()) {
+            rtp = std::make_unique<rtp_server>(io_context, rtpCfg, model_path, noiseSuppressionLevel, maxConnections, drain, taps);
+        }
+        // Optional io_uring backend serving the TCP stream protocol on its own port and thread.
+        std::unique_ptr<uring_server> uring;
+        if (uringPort > 0) {
+            uring = std::make_unique<uring_server>(static_cast<unsigned short>(uringPort), model_path,
+                                                   noiseSuppressionLevel, maxConnections, drain, taps);
+        }
+        auto active_count = [&srv, &rtp, &uring]() {
+            return srv.get_active_connections() + (rtp ? rtp->get_active_streams() : 0) +
+                   (uring ? uring->get_active_streams() : 0);
+        };
+
+//        unsigned int thread_count = std::thread::hardware_concurrency();
+//        for now run on 1 thread
+        unsigned int thread_count = 1;
+        if (thread_count == 0)
+            thread_count = 2;
+
+        // Optional admin listener reporting liveness, readiness and spare capacity for load
+        // balancers. Each listener family has its own max_connections budget.
+        int maxStreams = maxConnections * (1 + (rtp ? 1 : 0) + (uring ? 1 : 0));
+        unsigned cpuThreads = thread_count + (uring ? 1u : 0u);
+        admin_status status{drain, modelLoaded, active_count, [&srv]() { return srv.get_admission_stats(); },
+                            maxStreams, cpuThreads};
+        std::unique_ptr<admin_server> admin;
+        if (adminPort > 0) {
+            admin = std::make_unique<admin_server>(io_context, static_cast<unsigned short>(adminPort), status);
+        }
+        // Optional link for a front end (see front_end.hpp): this process reports the same spare
+        // capacity to it and takes over the client connections it passes on.
+        std::unique_ptr<handoff_listener> handoff;
+        if (!handoffSocketPath.empty()) {
+            handoff = std::make_unique<handoff_listener>(io_context, handoffSocketPath, status, maxConnections,
+                                                         [&srv](char kind, int fd) { srv.adopt(kind, fd); });
+        }
 
         // Set up signal handling for graceful shutdown.
         boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
-        signals.async_wait([&io_context, &srv, shutdownTimeoutSec](boost::system::error_code /*ec*/, int signo) {
+        signals.async_wait([&io_context, &srv, &rtp, &uring, &handoff, &drain, active_count, shutdownTimeoutSec](boost::system::error_code /*ec*/, int signo) {
             log_info("Shutdown signal (" + std::to_string(signo) + ") received. Initiating graceful shutdown...");
             // Stop accepting new connections.
             srv.shutdown();
-            // Set a deadline for graceful shutdown.
-            auto shutdown_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(shutdownTimeoutSec);
-            // Create a timer to check active connections periodically.
-            auto check_timer = std::make_shared<boost::asio::steady_timer>(io_context, std::chrono::seconds(1));
-            // Define a lambda to check connection count.
-            std::function<void()> check_connections;
-            check_connections = [&, check_timer]() {
-                if (srv.get_active_connections() == 0) {
-                    log_info("All connections closed. Shutting down gracefully.");
-                    io_context.stop();
-                } else if (std::chrono::steady_clock::now() >= shutdown_deadline) {
-                    log_info("Shutdown timeout reached. Forcing shutdown with " +
-                            std::to_string(srv.get_active_connections()) + " active connection(s).");
-                    io_context.stop();
-                } else {
-                    // Reschedule the timer to check again after 1 second.
-                    check_timer->expires_after(std::chrono::seconds(1));
-                    check_timer->async_wait([&](const boost::system::error_code& ec) {
-                        if (!ec) {
-                            check_connections();
-                        }
-                    });
-                }
-            };
-            check_connections();
+            if (handoff) {
+                handoff->close();
+            }
+            if (rtp) {
+                rtp->shutdown();
+            }
+            if (uring) {
+                uring->shutdown();
+            }
+            // Tell connected clients to move, then stop once the last stream has ended.
+            drain.begin(io_context, active_count, std::chrono::seconds(shutdownTimeoutSec),
+                        [&io_context]() { io_context.stop(); });
         });
 
-        // Run io_context on a thread pool.
+        // SIGUSR1 dumps the frame trace, like POST /trace on the admin endpoint.
+        boost::asio::signal_set traceSignal(io_context);
+        std::function<void()> awaitTraceSignal = [&traceSignal, &awaitTraceSignal]() {
+            traceSignal.async_wait([&awaitTraceSignal](boost::system::error_code ec, int) {
+                if (ec) {
+                    return;
+                }
+                if (tracer().dump() < 0) {
+                    log_error("Trace dump skipped: the previous one is still being written");
+                }
+                awaitTraceSignal();
+            });
+        };
+        if (tracer().enabled()) {
+            traceSignal.add(SIGUSR1);
+            awaitTraceSignal();
+        }
+
+        // Run io_context on a thread pool. Threads are named so they can be told apart in traces.
         std::vector<std::thread> threads;
-//        unsigned int thread_count = std::thread::hardware_concurrency();
-//        for now run on 1 thread
-        unsigned int thread_count = 1;
-        if (thread_count == 0)
-            thread_count = 2;
         for (unsigned int i = 0; i < thread_count; ++i) {
-            threads.emplace_back([&io_context]() { io_context.run(); });
+            threads.emplace_back([&io_context, i]() {
+                pthread_setname_np(pthread_self(), ("apm-io-" + std::to_string(i)).c_str());
+                io_context.run();
+            });
         }
         for (auto& t : threads) {
             t.join();
         }
+        usage().print_stats();
     } catch (std::exception& e) {
         log_error("Exception in main: " + std::string(e.what()));
     }
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <codecvt>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <locale>
+#include <memory>
+#include <string>
+
+#include <krisp-audio-sdk-nc.hpp>
+
+#include "audio_tap.hpp"
+#include "frame_trace.hpp"
+#include "input_conditioner.hpp"
+#include "logging.hpp"
+#include "usage_accounting.hpp"
+
+//
+// Per-stream noise cancellation pipeline: one Krisp Nc instance processing 20-ms frames at a
+// fixed sampling rate. Every transport (TCP sessions, RTP streams) drives its audio through one
+// of these so that all of them get identical processing.
+//
+// The suppression level and bypass can be changed while the stream runs (see session_control.hpp);
+// both are read once per frame, so a change takes effect on the next frame. In bypass the frame
+// is copied through without running the model, which frees the CPU for noisier streams.
+//
+// With a tap attached, every processed frame is also queued for recording together with its
+// input (see audio_tap.hpp); the input must therefore not be overwritten by the output.
+//
+// Ahead of the model, an input_conditioner can measure each frame, remove its DC offset and let
+// frames of digital silence bypass the model (see input_conditioner.hpp). Its mode starts at
+// the server-wide default_conditioning() and can be changed per stream like the level.
+//
+// Each pipeline is one trace session (see frame_trace.hpp); its frame count is the frame
+// sequence, and the processing of every sampled frame is recorded as a "process" span.
+//
+// The wall and thread-CPU time of every process() call is billed to the stream's usage, which
+// the transport names after the tenant in its handshake and also bills its I/O handlers to
+// (see usage_accounting.hpp). The CPU time is measured on a sample of the calls only; see
+// cpu_estimate.
+//
+class nc_pipeline {
+public:
+    using SamplingRate = Krisp::AudioSdk::SamplingRate;
+
+    nc_pipeline(const std::string& model_path, SamplingRate rate, float noiseSuppressionLevel)
+        : frameSamples_(static_cast<std::size_t>(rate) * 20 / 1000),
+          modelId_(std::hash<std::string>{}(model_path)),
+          noiseSuppressionLevel_(noiseSuppressionLevel),
+          conditioner_(frameSamples_),
+          conditioning_(default_conditioning().load(std::memory_order_relaxed)),
+          traceId_(tracer().new_session())
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        Krisp::AudioSdk::ModelInfo ncModelInfo;
+        ncModelInfo.path = converter.from_bytes(model_path);
+
+        Krisp::AudioSdk::NcSessionConfig ncCfg{
+            rate,                                       // Input sampling rate
+            Krisp::AudioSdk::FrameDuration::Fd20ms,     // Processing frame duration (20ms)
+            rate,                                       // Output sampling rate (same as input)
+            &ncModelInfo,                               // Model info
+            true,                                       // Collect session stats
+            nullptr                                     // No ringtone config
+        };
+
+        ncSession_ = Krisp::AudioSdk::Nc<int16_t>::create(ncCfg);
+    }
+
+    // Samples in one 20-ms frame at this pipeline's sampling rate.
+    std::size_t frame_samples() const {
+        return frameSamples_;
+    }
+
+    ~nc_pipeline() {
+        if (tap_) {
+            tap_->close();
+        }
+    }
+
+    nc_pipeline(const nc_pipeline&) = delete;
+    nc_pipeline& operator=(const nc_pipeline&) = delete;
+
+    // Sampling rate in Hz.
+    unsigned sample_rate() const {
+        return static_cast<unsigned>(frameSamples_ * 1000 / 20);
+    }
+
+    // Starts recording this stream when the writer selects it. Every transport names its stream
+    // here, so this is also where a traced stream's session id is logged.
+    void attach_tap(tap_writer& taps, const std::string& label) {
+        tap_ = taps.open(label, sample_rate(), frameSamples_);
+        if (tracer().enabled()) {
+            log_info("Trace session " + std::to_string(traceId_) + ": " + label);
+        }
+    }
+
+    uint64_t trace_id() const {
+        return traceId_;
+    }
+
+    // Whether the next frame to be processed is sampled for tracing; transports use it to
+    // record their own spans of that frame.
+    bool trace_next() const {
+        return tracer().sampled(traceId_, frames());
+    }
+
+    // Identifies the model file; pipelines with equal ids share a model.
+    std::size_t model_id() const {
+        return modelId_;
+    }
+
+    // Processes exactly one frame; in and out must each hold frame_samples() samples.
+    void process(const int16_t* in, int16_t* out) {
+        cpu_sample start = cpu_sample::now(usage_.sample_nc_cpu());
+        uint64_t seq = frames_.fetch_add(1, std::memory_order_relaxed);
+        bool traced = tracer().sampled(traceId_, seq);
+        auto begin = traced ? frame_tracer::clock::now() : frame_tracer::clock::time_point();
+        const int16_t* source = in;
+        bool silent = false;
+        conditioning_mode mode = conditioning_.load(std::memory_order_relaxed);
+        if (mode != conditioning_mode::off) {
+            source = conditioner_.condition(in, mode == conditioning_mode::on);
+            silent = mode == conditioning_mode::on && conditioner_.silent();
+        }
+        if (bypass_.load(std::memory_order_relaxed) || silent) {
+            if (!silent) {
+                bypassedFrames_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (out != source) {
+                std::memcpy(out, source, frameSamples_ * sizeof(int16_t));
+            }
+        } else {
+            ncSession_->process(source, frameSamples_, out, frameSamples_,
+                                noiseSuppressionLevel_.load(std::memory_order_relaxed), nullptr);
+        }
+        if (traced) {
+            tracer().record("process", traceId_, seq, begin);
+        }
+        if (tap_) {
+            tap_->push(in, out);
+        }
+        usage_.add_nc(start, cpu_sample::now(start.cpuNs >= 0));
+    }
+
+    float level() const {
+        return noiseSuppressionLevel_.load(std::memory_order_relaxed);
+    }
+
+    void set_level(float level) {
+        noiseSuppressionLevel_.store(level, std::memory_order_relaxed);
+    }
+
+    bool bypass() const {
+        return bypass_.load(std::memory_order_relaxed);
+    }
+
+    void set_bypass(bool bypass) {
+        bypass_.store(bypass, std::memory_order_relaxed);
+    }
+
+    conditioning_mode conditioning() const {
+        return conditioning_.load(std::memory_order_relaxed);
+    }
+
+    void set_conditioning(conditioning_mode mode) {
+        conditioning_.store(mode, std::memory_order_relaxed);
+    }
+
+    input_conditioner::stats input_stats() const {
+        return conditioner_.get_stats();
+    }
+
+    // Conditioning mode of new pipelines; set once at startup.
+    static std::atomic<conditioning_mode>& default_conditioning() {
+        static std::atomic<conditioning_mode> mode{conditioning_mode::off};
+        return mode;
+    }
+
+    session_usage& usage() {
+        return usage_;
+    }
+
+    uint64_t frames() const {
+        return frames_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bypassed_frames() const {
+        return bypassedFrames_.load(std::memory_order_relaxed);
+    }
+
+    Krisp::AudioSdk::SessionStats session_stats() {
+        Krisp::AudioSdk::SessionStats ncSessionStats;
+        ncSession_->getSessionStats(&ncSessionStats);
+        return ncSessionStats;
+    }
+
+    void print_stats() {
+        Krisp::AudioSdk::SessionStats ncSessionStats = session_stats();
+        log_info(std::string("#--- Session stats ---") +
+            "\n# - No Noise: " + std::to_string(ncSessionStats.noiseStats.noNoiseMs) + " ms" +
+            "\n# - Low Noise: " + std::to_string(ncSessionStats.noiseStats.lowNoiseMs) + " ms" +
+            "\n# - Medium Noise: " + std::to_string(ncSessionStats.noiseStats.mediumNoiseMs) + " ms" +
+            "\n# - High Noise: " + std::to_string(ncSessionStats.noiseStats.highNoiseMs) + " ms" +
+            "\n# - Talk Time: " + std::to_string(ncSessionStats.voiceStats.talkTimeMs) + " ms" +
+            "\n# - Frames: " + std::to_string(frames()) + " (" + std::to_string(bypassed_frames()) + " bypassed)" +
+            input_stats_text() +
+            "\n# - " + usage_.summary() +
+            (tap_ ? "\n# - Tap drops: " + std::to_string(tap_->dropped()) + " frames" : std::string())
+        );
+    }
+
+private:
+    std::string input_stats_text() const {
+        auto in = conditioner_.get_stats();
+        if (in.frames == 0) {
+            return std::string();
+        }
+        return "\n# - Input: peak max " + std::to_string(in.maxPeakDbfs) + " dBFS, mean RMS " +
+               std::to_string(in.meanRmsDbfs) + " dBFS, DC offset " + std::to_string(in.dcOffset) +
+               "\n# - Input silent frames: " + std::to_string(in.silentFrames) +
+               (conditioning() == conditioning_mode::on ? " (model bypassed)" : "") +
+               "\n# - Input clipped: " + std::to_string(in.clippedFrames) + " frames, " +
+               std::to_string(in.clippedSamples) + " samples";
+    }
+
+    std::size_t frameSamples_;
+    std::size_t modelId_;
+    std::atomic<float> noiseSuppressionLevel_;
+    std::atomic<bool> bypass_{false};
+    std::atomic<uint64_t> frames_{0};           // counters may be read by a control command while
+    std::atomic<uint64_t> bypassedFrames_{0};   // a batch runs on another thread
+    std::shared_ptr<Krisp::AudioSdk::Nc<int16_t>> ncSession_;
+    std::shared_ptr<audio_tap> tap_;
+    input_conditioner conditioner_;
+    std::atomic<conditioning_mode> conditioning_;
+    uint64_t traceId_;
+    session_usage usage_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include <boost/asio.hpp>
+
+// Peer description used in logs. Never throws: the peer may already have reset the connection.
+inline std::string peer_name(boost::asio::ip::tcp::socket& socket) {
+    boost::system::error_code ec;
+    auto endpoint = socket.remote_endpoint(ec);
+    return ec ? "unknown" : endpoint.address().to_string();
+}
+inline std::string peer_name(boost::asio::local::stream_protocol::socket& socket) {
+    // Unix-socket peers are normally unnamed; identify them by the listening path instead.
+    boost::system::error_code ec;
+    auto endpoint = socket.local_endpoint(ec);
+    return ec ? "unix:unknown" : "unix:" + endpoint.path();
+}
@@ -0,0 +1,566 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "drain_control.hpp"
+#include "g711.hpp"
+#include "logging.hpp"
+#include "nc_pipeline.hpp"
+
+//
+// RTP listener configuration.
+// port 0 disables the listener. L16 is accepted as 16 kHz mono on a dynamic payload type;
+// PCMU (0) and PCMA (8) use their static payload types at 8 kHz.
+//
+struct rtp_config {
+    int port = 0;
+    int l16PayloadType = 96;
+    int reorderWindow = 4;      // packets held back to put out-of-order arrivals back in sequence
+    int idleTimeoutMs = 5000;   // streams with no packets for this long are closed
+
+    bool enabled() const { return port > 0; }
+};
+
+enum class rtp_codec { pcmu, pcma, l16 };
+
+//
+// Fixed RTP header (RFC 3550, section 5.1) plus the payload it carries.
+//
+struct rtp_packet {
+    static constexpr std::size_t header_size = 12;
+
+    uint8_t payloadType = 0;
+    bool marker = false;
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;
+    uint32_t ssrc = 0;
+    const uint8_t* payload = nullptr;
+    std::size_t payloadSize = 0;
+
+    // Parses a datagram, skipping CSRCs and header extensions and stripping padding.
+    // Returns false for anything that is not a well-formed RTP version 2 packet.
+    bool parse(const uint8_t* data, std::size_t len) {
+        if (len < header_size || (data[0] >> 6) != 2)
+            return false;
+
+        bool padding = (data[0] & 0x20) != 0;
+        bool extension = (data[0] & 0x10) != 0;
+        std::size_t csrcCount = data[0] & 0x0F;
+        marker = (data[1] & 0x80) != 0;
+        payloadType = data[1] & 0x7F;
+        sequence = static_cast<uint16_t>((data[2] << 8) | data[3]);
+        timestamp = read_u32(data + 4);
+        ssrc = read_u32(data + 8);
+
+        std::size_t offset = header_size + csrcCount * 4;
+        if (extension) {
+            if (len < offset + 4)
+                return false;
+            std::size_t extWords = static_cast<std::size_t>((data[offset + 2] << 8) | data[offset + 3]);
+            offset += 4 + extWords * 4;
+        }
+        if (len < offset)
+            return false;
+
+        std::size_t end = len;
+        if (padding) {
+            std::size_t padBytes = data[len - 1];
+            if (padBytes == 0 || end - offset < padBytes)
+                return false;
+            end -= padBytes;
+        }
+        payload = data + offset;
+        payloadSize = end - offset;
+        return true;
+    }
+
+    // Serializes a header without CSRCs or extensions into out (at least header_size bytes).
+    void write_header(uint8_t* out) const {
+        out[0] = 0x80;
+        out[1] = static_cast<uint8_t>((marker ? 0x80 : 0x00) | (payloadType & 0x7F));
+        out[2] = static_cast<uint8_t>(sequence >> 8);
+        out[3] = static_cast<uint8_t>(sequence);
+        write_u32(out + 4, timestamp);
+        write_u32(out + 8, ssrc);
+    }
+
+private:
+    static uint32_t read_u32(const uint8_t* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+    static void write_u32(uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+};
+
+//
+// rtp_stream: one inbound RTP stream (SSRC + source address).
+// Packets pass through a small reorder window, are decoded into a sample queue and processed in
+// 20-ms frames by the stream's own nc_pipeline. Each processed frame goes back to the sender as
+// one RTP packet with the same payload type, carrying the input timestamps under our own SSRC.
+// A packet that is still missing when the window is full is counted lost and replaced with
+// silence, so timestamps stay continuous.
+//
+class rtp_stream {
+public:
+    static constexpr std::size_t max_payload = 1500;
+    // Sequence jumps larger than this (in packets) are treated as a restart, not as loss.
+    static constexpr int16_t max_gap = 100;
+
+    rtp_stream(const std::string& model_path, rtp_codec codec, uint8_t payloadType, float noiseSuppressionLevel,
+               std::size_t reorderWindow, uint32_t outSsrc, uint16_t outSequence)
+        : codec_(codec),
+          payloadType_(payloadType),
+          pipeline_(model_path, sampling_rate(codec), noiseSuppressionLevel),
+          window_(std::max<std::size_t>(reorderWindow, 1)),
+          outSsrc_(outSsrc),
+          outSequence_(outSequence)
+    {
+        for (auto& slot : window_) {
+            slot.payload.reserve(max_payload);
+        }
+        std::size_t frame = pipeline_.frame_samples();
+        samples_.reserve(frame + max_payload);
+        processed_.resize(frame);
+        packet_.resize(rtp_packet::header_size + frame * bytes_per_sample(codec));
+    }
+
+    static nc_pipeline::SamplingRate sampling_rate(rtp_codec codec) {
+        return codec == rtp_codec::l16 ? nc_pipeline::SamplingRate::Sr16000Hz : nc_pipeline::SamplingRate::Sr8000Hz;
+    }
+
+    // Accepts one packet. send(const uint8_t* data, std::size_t len) is invoked for every
+    // processed frame that becomes ready.
+    template <typename Send>
+    void on_packet(const rtp_packet& pkt, Send&& send) {
+        ++received_;
+        lastPacket_ = std::chrono::steady_clock::now();
+
+        if (!started_) {
+            started_ = true;
+            nextSequence_ = pkt.sequence;
+            outTimestamp_ = pkt.timestamp;
+        }
+
+        auto ahead = static_cast<int16_t>(static_cast<uint16_t>(pkt.sequence - nextSequence_));
+        if (ahead > max_gap || ahead < -max_gap) {
+            // The sender restarted its sequence numbering; deliver what is buffered and follow it.
+            resync(pkt.sequence, send);
+            ahead = 0;
+        } else if (ahead < 0) {
+            ++late_;
+            return;
+        }
+        // Too far ahead for the window: give up on the oldest missing packets.
+        while (static_cast<std::size_t>(ahead) >= window_.size()) {
+            release_next(send);
+            --ahead;
+        }
+
+        slot& s = window_[(head_ + static_cast<std::size_t>(ahead)) % window_.size()];
+        if (s.used) {
+            ++late_;
+            return;
+        }
+        s.used = true;
+        s.payload.assign(pkt.payload, pkt.payload + std::min(pkt.payloadSize, max_payload));
+
+        while (window_[head_].used) {
+            release_next(send);
+        }
+    }
+
+    std::chrono::steady_clock::time_point last_packet() const { return lastPacket_; }
+
+    void attach_tap(tap_writer& taps, const std::string& label) {
+        pipeline_.attach_tap(taps, label);
+    }
+
+    void print_stats(const std::string& label) {
+        pipeline_.print_stats();
+        log_info("#--- RTP stream stats (" + label + ") ---" +
+            "\n# - Packets received: " + std::to_string(received_) +
+            "\n# - Packets lost: " + std::to_string(lost_) +
+            "\n# - Packets late/duplicate: " + std::to_string(late_) +
+            "\n# - Packets sent: " + std::to_string(sent_)
+        );
+    }
+
+private:
+    // Reorder slots; window_[head_] holds the packet with sequence number nextSequence_.
+    struct slot {
+        bool used = false;
+        std::vector<uint8_t> payload;
+    };
+
+    static std::size_t bytes_per_sample(rtp_codec codec) {
+        return codec == rtp_codec::l16 ? 2 : 1;
+    }
+
+    // Delivers the packet at nextSequence_, or silence of the last packet's length if it never arrived.
+    template <typename Send>
+    void release_next(Send& send) {
+        slot& s = window_[head_];
+        if (s.used) {
+            decode(s.payload.data(), s.payload.size());
+            lastPacketSamples_ = s.payload.size() / bytes_per_sample(codec_);
+        } else {
+            ++lost_;
+            samples_.insert(samples_.end(), lastPacketSamples_, 0);
+        }
+        advance();
+        process_frames(send);
+    }
+
+    void advance() {
+        window_[head_].used = false;
+        head_ = (head_ + 1) % window_.size();
+        ++nextSequence_;
+    }
+
+    template <typename Send>
+    void resync(uint16_t sequence, Send& send) {
+        for (std::size_t i = 0; i < window_.size(); ++i) {
+            if (window_[head_].used) {
+                release_next(send);
+            } else {
+                advance();
+            }
+        }
+        nextSequence_ = sequence;
+    }
+
+    void decode(const uint8_t* payload, std::size_t len) {
+        switch (codec_) {
+        case rtp_codec::pcmu:
+            for (std::size_t i = 0; i < len; ++i)
+                samples_.push_back(ulaw_to_linear(payload[i]));
+            break;
+        case rtp_codec::pcma:
+            for (std::size_t i = 0; i < len; ++i)
+                samples_.push_back(alaw_to_linear(payload[i]));
+            break;
+        case rtp_codec::l16:
+            for (std::size_t i = 0; i + 1 < len; i += 2)
+                samples_.push_back(static_cast<int16_t>((payload[i] << 8) | payload[i + 1]));
+            break;
+        }
+    }
+
+    template <typename Send>
+    void process_frames(Send& send) {
+        std::size_t frame = pipeline_.frame_samples();
+        std::size_t consumed = 0;
+        while (samples_.size() - consumed >= frame) {
+            pipeline_.process(samples_.data() + consumed, processed_.data());
+            consumed += frame;
+
+            rtp_packet out;
+            out.payloadType = payloadType_;
+            out.marker = (sent_ == 0);
+            out.sequence = outSequence_++;
+            out.timestamp = outTimestamp_;
+            out.ssrc = outSsrc_;
+            out.write_header(packet_.data());
+            encode(packet_.data() + rtp_packet::header_size);
+            outTimestamp_ += static_cast<uint32_t>(frame);
+
+            send(packet_.data(), packet_.size());
+            ++sent_;
+        }
+        samples_.erase(samples_.begin(), samples_.begin() + static_cast<std::ptrdiff_t>(consumed));
+    }
+
+    void encode(uint8_t* out) const {
+        switch (codec_) {
+        case rtp_codec::pcmu:
+            for (int16_t sample : processed_)
+                *out++ = linear_to_ulaw(sample);
+            break;
+        case rtp_codec::pcma:
+            for (int16_t sample : processed_)
+                *out++ = linear_to_alaw(sample);
+            break;
+        case rtp_codec::l16:
+            for (int16_t sample : processed_) {
+                *out++ = static_cast<uint8_t>(static_cast<uint16_t>(sample) >> 8);
+                *out++ = static_cast<uint8_t>(sample);
+            }
+            break;
+        }
+    }
+
+    rtp_codec codec_;
+    uint8_t payloadType_;
+    nc_pipeline pipeline_;
+
+    std::vector<slot> window_;
+    std::size_t head_ = 0;
+    bool started_ = false;
+    uint16_t nextSequence_ = 0;
+    std::size_t lastPacketSamples_ = 0;
+
+    std::vector<int16_t> samples_;
+    std::vector<int16_t> processed_;
+    std::vector<uint8_t> packet_;
+    uint32_t outSsrc_;
+    uint16_t outSequence_;
+    uint32_t outTimestamp_ = 0;
+
+    std::chrono::steady_clock::time_point lastPacket_;
+    uint64_t received_ = 0;
+    uint64_t lost_ = 0;
+    uint64_t late_ = 0;
+    uint64_t sent_ = 0;
+};
+
+//
+// rtp_server: UDP listener for RTP media legs.
+// Streams are keyed by SSRC and source address and created on their first packet. The socket,
+// the stream table and the idle sweep all run on one strand; frames are processed inline in the
+// receive handler, which keeps a stream's packets strictly ordered without any locking.
+// RTP has no in-band channel back to the client, so draining only stops new streams; open ones
+// end when they go idle, or are closed at the drain timeout.
+//
+class rtp_server : private drain_listener {
+public:
+    using udp = boost::asio::ip::udp;
+
+    rtp_server(boost::asio::io_context& io_context, const rtp_config& cfg, const std::string& model_path,
+               float noiseSuppressionLevel, int maxStreams, drain_control& drain, tap_writer& taps)
+        : strand_(boost::asio::make_strand(io_context)),
+          socket_(strand_, udp::endpoint(udp::v4(), static_cast<unsigned short>(cfg.port))),
+          sweepTimer_(strand_),
+          cfg_(cfg),
+          model_path_(model_path),
+          noiseSuppressionLevel_(noiseSuppressionLevel),
+          maxStreams_(maxStreams),
+          drain_(drain),
+          taps_(taps),
+          rng_(std::random_device{}())
+    {
+        socket_.non_blocking(true);
+        log_info("RTP listening on " + socket_.local_endpoint().address().to_string() +
+                 ":" + std::to_string(socket_.local_endpoint().port()) +
+                 " | L16 payload type: " + std::to_string(cfg_.l16PayloadType));
+        do_receive();
+        schedule_sweep();
+        drain_.join(*this);
+    }
+
+    ~rtp_server() {
+        drain_.leave(*this);
+    }
+
+    // Stops accepting new streams. Existing streams run until they go idle, then the socket closes.
+    void shutdown() {
+        boost::asio::post(strand_, [this]() {
+            draining_ = true;
+            log_info("RTP listener draining. No longer accepting new streams.");
+            close_if_drained();
+        });
+    }
+
+    int get_active_streams() const {
+        return activeStreams_.load();
+    }
+
+private:
+    void on_drain() override {
+    }
+
+    void on_drain_timeout() override {
+        boost::asio::post(strand_, [this]() {
+            for (auto& entry : streams_) {
+                entry.second->print_stats(describe(entry.first));
+            }
+            activeStreams_ -= static_cast<int>(streams_.size());
+            streams_.clear();
+            log_info("RTP streams closed at drain timeout.");
+            close_if_drained();
+            drain_.stream_closed();
+        });
+    }
+
+    struct stream_key {
+        uint32_t ssrc;
+        udp::endpoint endpoint;
+
+        bool operator<(const stream_key& other) const {
+            return std::tie(ssrc, endpoint) < std::tie(other.ssrc, other.endpoint);
+        }
+    };
+
+    static std::string describe(const stream_key& key) {
+        return key.endpoint.address().to_string() + ":" + std::to_string(key.endpoint.port()) +
+               " ssrc=" + std::to_string(key.ssrc);
+    }
+
+    void do_receive() {
+        socket_.async_receive_from(boost::asio::buffer(recv_buffer_), sender_,
+            [this](boost::system::error_code ec, std::size_t bytes_transferred) {
+                if (ec == boost::asio::error::operation_aborted || !socket_.is_open()) {
+                    return;
+                }
+                if (!ec) {
+                    handle_datagram(bytes_transferred);
+                } else {
+                    log_error("RTP receive error: " + ec.message());
+                }
+                do_receive();
+            }
+        );
+    }
+
+    void handle_datagram(std::size_t len) {
+        rtp_packet pkt;
+        if (!pkt.parse(recv_buffer_.data(), len)) {
+            ++malformed_;
+            return;
+        }
+
+        stream_key key{pkt.ssrc, sender_};
+        auto it = streams_.find(key);
+        if (it == streams_.end()) {
+            it = open_stream(key, pkt.payloadType);
+            if (it == streams_.end()) {
+                return;
+            }
+        }
+
+        udp::endpoint destination = key.endpoint;
+        it->second->on_packet(pkt, [this, &destination](const uint8_t* data, std::size_t size) {
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(data, size), destination, 0, ec);
+            if (ec) {
+                ++sendErrors_;
+            }
+        });
+    }
+
+    std::map<stream_key, std::unique_ptr<rtp_stream>>::iterator open_stream(const stream_key& key, uint8_t payloadType) {
+        if (draining_) {
+            return streams_.end();
+        }
+
+        rtp_codec codec;
+        if (payloadType == 0) {
+            codec = rtp_codec::pcmu;
+        } else if (payloadType == 8) {
+            codec = rtp_codec::pcma;
+        } else if (payloadType == cfg_.l16PayloadType) {
+            codec = rtp_codec::l16;
+        } else {
+            if (++unsupported_ == 1) {
+                log_error("Unsupported RTP payload type " + std::to_string(payloadType) + " from " + describe(key));
+            }
+            return streams_.end();
+        }
+
+        if (static_cast<int>(streams_.size()) >= maxStreams_) {
+            if (++rejected_ == 1) {
+                log_error("Max RTP streams reached. Rejecting stream from " + describe(key));
+            }
+            return streams_.end();
+        }
+
+        try {
+            auto stream = std::make_unique<rtp_stream>(model_path_, codec, payloadType, noiseSuppressionLevel_,
+                                                       static_cast<std::size_t>(cfg_.reorderWindow),
+                                                       static_cast<uint32_t>(rng_()), static_cast<uint16_t>(rng_()));
+            stream->attach_tap(taps_, "rtp-" + describe(key));
+            ++activeStreams_;
+            ++totalStreams_;
+            rejected_ = 0;
+            unsupported_ = 0;
+            log_info("New RTP stream from " + describe(key) +
+                     " | Active: " + std::to_string(activeStreams_.load()) +
+                     " | Total: " + std::to_string(totalStreams_));
+            return streams_.emplace(key, std::move(stream)).first;
+        } catch (std::exception& e) {
+            log_error("Could not create RTP stream for " + describe(key) + ": " + e.what());
+            return streams_.end();
+        }
+    }
+
+    void schedule_sweep() {
+        sweepTimer_.expires_after(std::chrono::seconds(1));
+        sweepTimer_.async_wait([this](boost::system::error_code ec) {
+            if (!ec) {
+                sweep_idle_streams();
+                schedule_sweep();
+            }
+        });
+    }
+
+    void sweep_idle_streams() {
+        auto deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(cfg_.idleTimeoutMs);
+        for (auto it = streams_.begin(); it != streams_.end();) {
+            if (it->second->last_packet() < deadline) {
+                --activeStreams_;
+                log_info("RTP stream idle, closing " + describe(it->first) +
+                         " | Active: " + std::to_string(activeStreams_.load()) +
+                         " | Total: " + std::to_string(totalStreams_));
+                it->second->print_stats(describe(it->first));
+                it = streams_.erase(it);
+                drain_.stream_closed();
+            } else {
+                ++it;
+            }
+        }
+        if (malformed_ > 0 || sendErrors_ > 0) {
+            log_error("RTP: dropped " + std::to_string(malformed_) + " malformed packet(s), " +
+                      std::to_string(sendErrors_) + " send error(s)");
+            malformed_ = 0;
+            sendErrors_ = 0;
+        }
+        close_if_drained();
+    }
+
+    void close_if_drained() {
+        if (draining_ && streams_.empty() && socket_.is_open()) {
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+            sweepTimer_.cancel();
+            log_info("RTP listener closed.");
+        }
+    }
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    udp::socket socket_;
+    boost::asio::steady_timer sweepTimer_;
+    rtp_config cfg_;
+    std::string model_path_;
+    float noiseSuppressionLevel_;
+    int maxStreams_;
+    drain_control& drain_;
+    tap_writer& taps_;
+    std::mt19937 rng_;
+
+    std::array<uint8_t, 2048> recv_buffer_;
+    udp::endpoint sender_;
+    std::map<stream_key, std::unique_ptr<rtp_stream>> streams_;
+    bool draining_ = false;
+
+    std::atomic<int> activeStreams_{0};
+    int totalStreams_ = 0;
+    uint64_t malformed_ = 0;
+    uint64_t sendErrors_ = 0;
+    uint64_t unsupported_ = 0;
+    uint64_t rejected_ = 0;
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "nc_pipeline.hpp"
+#include "stream_message.hpp"
+
+//
+// In-band control of a running stream, so a client can retune its own session without
+// reconnecting. WebSocket clients send a text message and shared-memory clients a line on the
+// control connection, each holding one JSON object:
+//   {"level": 0..100}          set the noise suppression level (percent)
+//   {"bypass": true|false}     pass audio through unprocessed, or resume processing
+//   {"stats": true}            request the session statistics
+//   {"conditioning": "off"|"measure"|"on"}   input conditioning (see input_conditioner.hpp)
+// Keys may be combined. Every command has one JSON reply: {"event":"control",...} with the
+// resulting settings, {"event":"stats",...}, or {"event":"error","message":...}, in which case
+// nothing was changed.
+//
+// TCP and Unix-socket clients send the same commands inside their byte stream once they have
+// asked for framing in the handshake (see stream_message.hpp and stream_demux); the replies come
+// back as control messages between the audio messages of the output.
+//
+namespace session_control {
+
+constexpr int level_max = 100;
+
+inline std::string json_number(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.2f", value);
+    return text;
+}
+
+inline std::string error_reply(const std::string& message) {
+    return "{\"event\":\"error\",\"message\":\"" + message + "\"}";
+}
+
+inline std::string stats_reply(nc_pipeline& pipeline) {
+    auto stats = pipeline.session_stats();
+    auto in = pipeline.input_stats();
+    std::string input;
+    if (in.frames > 0) {
+        input = ",\"input_peak_dbfs\":" + json_number(in.peakDbfs) +
+                ",\"input_rms_dbfs\":" + json_number(in.rmsDbfs) +
+                ",\"input_max_peak_dbfs\":" + json_number(in.maxPeakDbfs) +
+                ",\"input_mean_rms_dbfs\":" + json_number(in.meanRmsDbfs) +
+                ",\"input_dc_offset\":" + json_number(in.dcOffset) +
+                ",\"input_silent_frames\":" + std::to_string(in.silentFrames) +
+                ",\"input_clipped_frames\":" + std::to_string(in.clippedFrames) +
+                ",\"input_clipped_samples\":" + std::to_string(in.clippedSamples);
+    }
+    return "{\"event\":\"stats\""
+           ",\"level\":" + json_number(pipeline.level()) +
+           ",\"bypass\":" + (pipeline.bypass() ? "true" : "false") +
+           ",\"conditioning\":\"" + to_string(pipeline.conditioning()) + "\"" + input +
+           ",\"frames\":" + std::to_string(pipeline.frames()) +
+           ",\"bypassed_frames\":" + std::to_string(pipeline.bypassed_frames()) +
+           ",\"no_noise_ms\":" + std::to_string(stats.noiseStats.noNoiseMs) +
+           ",\"low_noise_ms\":" + std::to_string(stats.noiseStats.lowNoiseMs) +
+           ",\"medium_noise_ms\":" + std::to_string(stats.noiseStats.mediumNoiseMs) +
+           ",\"high_noise_ms\":" + std::to_string(stats.noiseStats.highNoiseMs) +
+           ",\"talk_time_ms\":" + std::to_string(stats.voiceStats.talkTimeMs) + "}";
+}
+
+// Returns the position of the quote that ends the JSON string starting at pos, or npos.
+inline std::size_t string_end(const std::string& command, std::size_t pos) {
+    for (++pos; pos < command.size(); ++pos) {
+        if (command[pos] == '\\') {
+            ++pos;
+        } else if (command[pos] == '"') {
+            return pos;
+        }
+    }
+    return std::string::npos;
+}
+
+// Returns the position just past the JSON value starting at pos (nested objects, arrays and
+// strings included), or npos when it does not end.
+inline std::size_t value_end(const std::string& command, std::size_t pos) {
+    int depth = 0;
+    for (; pos < command.size(); ++pos) {
+        char c = command[pos];
+        if (c == '"') {
+            pos = string_end(command, pos);
+            if (pos == std::string::npos) {
+                return pos;
+            }
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return pos;
+            }
+            --depth;
+        } else if (c == ',' && depth == 0) {
+            return pos;
+        }
+    }
+    return std::string::npos;
+}
+
+// Finds "key" among the top-level keys of a JSON object and returns the position of its value,
+// or npos. Keys are only matched in key position, so text inside a string value never matches.
+inline std::size_t find_value(const std::string& command, const char* key) {
+    constexpr const char* space = " \t\r\n";
+    std::size_t pos = command.find_first_not_of(space);
+    if (pos == std::string::npos || command[pos] != '{') {
+        return std::string::npos;
+    }
+    std::size_t keyLength = std::strlen(key);
+    for (++pos;;) {
+        pos = command.find_first_not_of(space, pos);
+        if (pos == std::string::npos || command[pos] != '"') {
+            return std::string::npos;
+        }
+        std::size_t end = string_end(command, pos);
+        if (end == std::string::npos) {
+            return end;
+        }
+        bool match = end - pos - 1 == keyLength && command.compare(pos + 1, keyLength, key) == 0;
+        pos = command.find_first_not_of(space, end + 1);
+        if (pos == std::string::npos || command[pos] != ':') {
+            return std::string::npos;
+        }
+        pos = command.find_first_not_of(space, pos + 1);
+        if (pos == std::string::npos || match) {
+            return pos;
+        }
+        pos = value_end(command, pos);
+        if (pos == std::string::npos || command[pos] != ',') {
+            return std::string::npos;
+        }
+        ++pos;
+    }
+}
+
+inline bool parse_bool(const std::string& command, std::size_t pos, bool& value) {
+    if (command.compare(pos, 4, "true") == 0) {
+        value = true;
+        return true;
+    }
+    if (command.compare(pos, 5, "false") == 0) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+// Applies one JSON command to the pipeline and returns the reply. Settings are the pipeline's
+// atomics, but a stats request reads the Nc session's statistics, so callers run this between
+// frames of the stream (on its strand), never while one of its frames is being processed.
+inline std::string apply(nc_pipeline& pipeline, const std::string& command) {
+    std::size_t levelPos = find_value(command, "level");
+    std::size_t bypassPos = find_value(command, "bypass");
+    std::size_t statsPos = find_value(command, "stats");
+    std::size_t conditioningPos = find_value(command, "conditioning");
+    if (levelPos == std::string::npos && bypassPos == std::string::npos && statsPos == std::string::npos &&
+        conditioningPos == std::string::npos) {
+        return error_reply("expected level, bypass, stats or conditioning");
+    }
+
+    // Validate everything before changing anything.
+    float level = pipeline.level();
+    if (levelPos != std::string::npos) {
+        const char* begin = command.c_str() + levelPos;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin || !std::isfinite(value) || value < 0 || value > level_max) {
+            return error_reply("level must be a number from 0 to 100");
+        }
+        level = static_cast<float>(value);
+    }
+    bool bypass = pipeline.bypass();
+    if (bypassPos != std::string::npos && !parse_bool(command, bypassPos, bypass)) {
+        return error_reply("bypass must be true or false");
+    }
+    conditioning_mode conditioning = pipeline.conditioning();
+    if (conditioningPos != std::string::npos) {
+        std::size_t end = command.find('"', conditioningPos + 1);
+        if (command[conditioningPos] != '"' || end == std::string::npos ||
+            !parse_conditioning_mode(command.substr(conditioningPos + 1, end - conditioningPos - 1), conditioning)) {
+            return error_reply("conditioning must be off, measure or on");
+        }
+    }
+    bool stats = false;
+    if (statsPos != std::string::npos && !parse_bool(command, statsPos, stats)) {
+        return error_reply("stats must be true or false");
+    }
+
+    pipeline.set_level(level);
+    pipeline.set_bypass(bypass);
+    pipeline.set_conditioning(conditioning);
+    if (stats) {
+        return stats_reply(pipeline);
+    }
+    return "{\"event\":\"control\",\"level\":" + json_number(level) +
+           ",\"bypass\":" + (bypass ? "true" : "false") +
+           ",\"conditioning\":\"" + to_string(conditioning) + "\"}";
+}
+
+//
+// stream_demux: the input of a TCP or Unix-socket stream in framed mode (framed=1 in the
+// handshake), split into stream_message audio and control messages. Commands may be at most
+// max_command bytes; any other type, or a longer command, is a protocol error and the stream is
+// closed.
+//
+// Received bytes go into space() and are committed; take_audio() then moves audio out and hands
+// each complete command over in arrival order. It stops once the caller's buffer is full, so a
+// command sent after a frame is applied after that frame. The buffers are allocated once, so the
+// per-frame path stays off the heap.
+//
+template <std::size_t Capacity>
+class stream_demux {
+public:
+    static constexpr std::size_t header_size = stream_message::header_size;
+    static constexpr std::size_t max_command = 1024;
+    static constexpr char audio = stream_message::audio;
+    static constexpr char control = stream_message::control;
+
+    stream_demux() {
+        command_.reserve(max_command);
+    }
+
+    char* space() {
+        return raw_.data() + end_;
+    }
+
+    std::size_t space_size() const {
+        return Capacity - end_;
+    }
+
+    void commit(std::size_t n) {
+        end_ += n;
+    }
+
+    // Takes bytes that were already received elsewhere; at most space_size().
+    void load(const char* data, std::size_t n) {
+        std::memcpy(space(), data, n);
+        commit(n);
+    }
+
+    bool failed() const {
+        return failed_;
+    }
+
+    // Moves up to size audio bytes into out and calls onCommand(const std::string&) for every
+    // command before them. Returns the number of audio bytes.
+    template <typename OnCommand>
+    std::size_t take_audio(char* out, std::size_t size, OnCommand&& onCommand) {
+        std::size_t written = 0;
+        while (begin_ < end_ && written < size && !failed_) {
+            if (headerFilled_ < header_size) {
+                header_[headerFilled_++] = static_cast<unsigned char>(raw_[begin_++]);
+                if (headerFilled_ == header_size) {
+                    type_ = static_cast<char>(header_[0]);
+                    remaining_ = header_[1] | static_cast<std::size_t>(header_[2]) << 8;
+                    if ((type_ != audio && type_ != control) || (type_ == control && remaining_ > max_command)) {
+                        failed_ = true;
+                    } else if (remaining_ == 0) {
+                        finish(onCommand);
+                    }
+                }
+                continue;
+            }
+            std::size_t n = std::min(remaining_, end_ - begin_);
+            if (type_ == audio) {
+                n = std::min(n, size - written);
+                std::memcpy(out + written, raw_.data() + begin_, n);
+                written += n;
+            } else {
+                command_.append(raw_.data() + begin_, n);
+            }
+            begin_ += n;
+            remaining_ -= n;
+            if (remaining_ == 0) {
+                finish(onCommand);
+            }
+        }
+        // Keep what is left at the front, so the next read has the whole remaining space.
+        std::memmove(raw_.data(), raw_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        return written;
+    }
+
+private:
+    template <typename OnCommand>
+    void finish(OnCommand& onCommand) {
+        if (type_ == control) {
+            onCommand(command_);
+            command_.clear();
+        }
+        headerFilled_ = 0;
+    }
+
+    std::array<char, Capacity> raw_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+    unsigned char header_[header_size] = {};
+    std::size_t headerFilled_ = 0;
+    char type_ = 0;
+    std::size_t remaining_ = 0;
+    std::string command_;
+    bool failed_ = false;
+};
+
+}
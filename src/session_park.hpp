@@ -0,0 +1,311 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "logging.hpp"
+#include "nc_pipeline.hpp"
+
+//
+// Session resume options; a zero grace period disables resume.
+//
+struct resume_config {
+    std::chrono::milliseconds grace{0};     // how long a disconnected stream stays parked
+    // Parked streams kept at most; the oldest goes first. This count is the memory cap: nearly all
+    // of a parked stream's memory is its Nc instance, whose size the SDK does not report, so
+    // the limit is set in streams rather than bytes (size it as budget / per-stream footprint).
+    std::size_t maxParked = 64;
+
+    bool enabled() const {
+        return grace.count() > 0;
+    }
+};
+
+//
+// session_park: streams whose connection dropped, kept warm for a short grace period. A client
+// that reconnects with the stream's resume token continues on the same nc_pipeline: the same Nc
+// instance with its adapted noise model, the same frame sequence, tap and usage account. Neither
+// model instantiation nor re-convergence is repeated.
+//
+// Tokens are 128 random bits in hex and are issued when a client asks for one in its handshake
+// (see read_handshake). A parked stream holds its pipeline, which is most of a session's memory,
+// but no connection slot; at most maxParked are kept, and parking one more drops the one parked
+// longest. A stream is resumed only by the tenant that parked it.
+//
+// After a network blip the client often reconnects before the server has noticed that the old
+// connection is gone. Streams that hold a token are therefore also registered while they are
+// live (attach_live); a reconnect that finds its token live instead of parked takes the stream
+// over (take_over): the old connection is closed, and its pipeline goes straight to the new one
+// instead of being parked.
+//
+// close() drops every parked stream and refuses further parking; the server calls it when it
+// starts draining, since nobody can resume on a server that is going away.
+//
+class session_park {
+public:
+    struct stats {
+        uint64_t parked;
+        uint64_t resumed;
+        uint64_t takenOver;     // resumed from a stream whose old connection was still open
+        uint64_t expired;
+        uint64_t evicted;
+    };
+
+    //
+    // A live stream holding a resume token.
+    //
+    class resumable_stream {
+    public:
+        // A client reconnected with this stream's token: close the connection, so the stream
+        // ends and hands its pipeline to park(). Called from any thread.
+        virtual void on_taken_over() = 0;
+
+    protected:
+        ~resumable_stream() = default;
+    };
+
+    using takeover_handler = std::function<void(std::unique_ptr<nc_pipeline>)>;
+
+    session_park(boost::asio::io_context& io_context, const resume_config& cfg)
+        : io_context_(io_context),
+          cfg_(cfg)
+    {
+        if (cfg_.enabled()) {
+            log_info("Session resume: streams stay parked for " + std::to_string(cfg_.grace.count()) +
+                     " ms after a disconnect, " + std::to_string(cfg_.maxParked) + " at most");
+        }
+    }
+
+    bool enabled() const {
+        return cfg_.enabled();
+    }
+
+    std::string issue_token() {
+        std::random_device random;
+        char token[33];
+        for (int i = 0; i < 4; ++i) {
+            std::snprintf(token + 8 * i, 9, "%08x", static_cast<unsigned>(random()));
+        }
+        return token;
+    }
+
+    void attach_live(const std::string& token, const std::string& tenant, resumable_stream& stream) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        live_[token] = live_entry{tenant, &stream};
+    }
+
+    // Call after park(): until then a reconnect may still take the stream over.
+    void detach_live(const std::string& token, resumable_stream& stream) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = live_.find(token);
+        if (it != live_.end() && it->second.stream == &stream) {
+            live_.erase(it);
+        }
+    }
+
+    // Parks a stream's pipeline under its token, taking ownership, or hands it to the connection
+    // that took the stream over. Returns false, leaving the pipeline with the caller, once the
+    // park is closed.
+    bool park(const std::string& token, std::unique_ptr<nc_pipeline>& pipeline) {
+        std::unique_ptr<nc_pipeline> evicted;
+        takeover_handler takeover;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto waiting = takeovers_.find(token);
+            if (waiting != takeovers_.end()) {
+                takeover = std::move(waiting->second);
+                takeovers_.erase(waiting);
+            }
+        }
+        if (takeover) {
+            log_info("Resume: handing stream " + short_token(token) + " to its new connection | Frames: " +
+                     std::to_string(pipeline->frames()));
+            takeover(std::move(pipeline));
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_ || !cfg_.enabled()) {
+                return false;
+            }
+            if (parked_.size() >= cfg_.maxParked && !parked_.empty()) {
+                auto oldest = parked_.begin();
+                for (auto it = parked_.begin(); it != parked_.end(); ++it) {
+                    if (it->second.id < oldest->second.id) {
+                        oldest = it;
+                    }
+                }
+                log_info("Resume: dropping parked stream " + short_token(oldest->first) + " to stay within " +
+                         std::to_string(cfg_.maxParked));
+                evicted = std::move(oldest->second.pipeline);
+                parked_.erase(oldest);
+                ++stats_.evicted;
+            }
+
+            uint64_t id = ++nextId_;
+            auto& entry = parked_[token];
+            entry.id = id;
+            entry.tenant = pipeline->usage().identity().tenant;
+            entry.pipeline = std::move(pipeline);
+            entry.timer = std::make_unique<boost::asio::steady_timer>(io_context_, cfg_.grace);
+            entry.timer->async_wait([this, token, id](boost::system::error_code ec) {
+                if (!ec) {
+                    expire(token, id);
+                }
+            });
+            ++stats_.parked;
+            log_info("Resume: parked stream " + short_token(token) + " for " + std::to_string(cfg_.grace.count()) +
+                     " ms | Frames: " + std::to_string(entry.pipeline->frames()) +
+                     " | Parked: " + std::to_string(parked_.size()));
+        }
+        if (evicted) {
+            evicted->print_stats();
+        }
+        return true;
+    }
+
+    // Takes the pipeline parked under token by tenant, or returns null when there is none (never
+    // issued, expired, dropped, already resumed or parked by another tenant).
+    std::unique_ptr<nc_pipeline> take(const std::string& token, const std::string& tenant) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = parked_.find(token);
+        if (it == parked_.end() || it->second.tenant != tenant) {
+            log_info("Resume: no parked stream " + short_token(token) + " for tenant " + tenant);
+            return nullptr;
+        }
+        // Erasing the entry destroys its timer, which cancels the expiry.
+        std::unique_ptr<nc_pipeline> pipeline = std::move(it->second.pipeline);
+        parked_.erase(it);
+        ++stats_.resumed;
+        log_info("Resume: resumed stream " + short_token(token) + " | Frames: " + std::to_string(pipeline->frames()));
+        return pipeline;
+    }
+
+    // For a token that is not parked but held by a live stream of tenant: asks that stream to
+    // end and calls resumed with its pipeline once it has ended, from the thread it ends on.
+    // resumed gets null if the stream ends without a pipeline to hand over (the server started
+    // draining). Returns false when there is no such stream, another connection is already
+    // taking it over, or the park is closed; resumed is not called then.
+    bool take_over(const std::string& token, const std::string& tenant, takeover_handler resumed) {
+        std::unique_ptr<nc_pipeline> parked;
+        resumable_stream* stream = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = parked_.find(token);
+            if (it != parked_.end() && it->second.tenant == tenant) {
+                // Parked since the caller looked.
+                parked = std::move(it->second.pipeline);
+                parked_.erase(it);
+                ++stats_.resumed;
+            } else {
+                auto live = live_.find(token);
+                if (closed_ || live == live_.end() || live->second.tenant != tenant || takeovers_.count(token) > 0) {
+                    return false;
+                }
+                stream = live->second.stream;
+                takeovers_[token] = std::move(resumed);
+                ++stats_.takenOver;
+            }
+        }
+        if (parked) {
+            log_info("Resume: resumed stream " + short_token(token) + " | Frames: " + std::to_string(parked->frames()));
+            resumed(std::move(parked));
+            return true;
+        }
+        log_info("Resume: stream " + short_token(token) + " is still connected; taking it over");
+        stream->on_taken_over();
+        return true;
+    }
+
+    void close() {
+        std::vector<std::unique_ptr<nc_pipeline>> dropped;
+        std::vector<takeover_handler> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_) {
+                return;
+            }
+            closed_ = true;
+            for (auto& entry : takeovers_) {
+                waiting.push_back(std::move(entry.second));
+            }
+            takeovers_.clear();
+            for (auto& entry : parked_) {
+                dropped.push_back(std::move(entry.second.pipeline));
+            }
+            parked_.clear();
+            if (cfg_.enabled()) {
+                log_info("Resume: " + std::to_string(stats_.parked) + " parked | " + std::to_string(stats_.resumed) +
+                         " resumed | " + std::to_string(stats_.takenOver) + " taken over while connected | " +
+                         std::to_string(stats_.expired) + " expired | " +
+                         std::to_string(stats_.evicted) + " dropped over the limit | " +
+                         std::to_string(dropped.size()) + " dropped at shutdown");
+            }
+        }
+        for (auto& pipeline : dropped) {
+            pipeline->print_stats();
+        }
+        for (auto& resumed : waiting) {
+            resumed(nullptr);
+        }
+    }
+
+    stats get_stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    // Tokens are credentials; logs only show their start.
+    static std::string short_token(const std::string& token) {
+        return token.substr(0, 8) + "...";
+    }
+
+private:
+    struct entry {
+        uint64_t id = 0;                // parking order; also tells a stale expiry from a fresh one
+        std::string tenant;
+        std::unique_ptr<nc_pipeline> pipeline;
+        std::unique_ptr<boost::asio::steady_timer> timer;
+    };
+
+    struct live_entry {
+        std::string tenant;
+        resumable_stream* stream;
+    };
+
+    void expire(const std::string& token, uint64_t id) {
+        std::unique_ptr<nc_pipeline> pipeline;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = parked_.find(token);
+            if (it == parked_.end() || it->second.id != id) {
+                return;
+            }
+            pipeline = std::move(it->second.pipeline);
+            parked_.erase(it);
+            ++stats_.expired;
+            log_info("Resume: grace period of stream " + short_token(token) + " expired");
+        }
+        pipeline->print_stats();
+    }
+
+    boost::asio::io_context& io_context_;
+    resume_config cfg_;
+    mutable std::mutex mutex_;      // guards everything below
+    std::map<std::string, entry> parked_;
+    std::map<std::string, live_entry> live_;
+    std::map<std::string, takeover_handler> takeovers_;     // live streams being taken over
+    uint64_t nextId_ = 0;
+    bool closed_ = false;
+    stats stats_{};
+};
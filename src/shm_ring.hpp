@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+//
+// Shared-memory frame transport layout, shared by the server and its clients.
+//
+// The client creates one shared memory region (a memfd, sealed with F_SEAL_SHRINK once sized)
+// holding a header followed by two single-producer/single-consumer rings of fixed-size frames:
+// "in" (client -> server) and "out" (server -> client). It passes the memfd and two eventfds to the server over the
+// --shm-socket control connection with SCM_RIGHTS; the control connection stays open for the
+// life of the stream and closing it ends the stream.
+//
+// Indices are free-running 32-bit counters; slot = index % capacity, so capacity must be a power
+// of two for the slots to stay consistent when the counters wrap. Each side only signals the
+// other's eventfd when the peer has announced it is about to sleep (the *Waiting flags), so a
+// busy stream exchanges frames without any syscalls besides the wake-ups it actually needs.
+//
+// The server processes frames in place, reading the input slot and writing the output slot
+// directly in the mapping; no audio is copied on the server side.
+//
+struct shm_ring_header {
+    static constexpr uint32_t magic_value = 0x4B4E4331;   // "KNC1"
+    static constexpr uint32_t version_value = 1;
+    static constexpr uint32_t max_capacity = 1024;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frameBytes;
+    uint32_t capacity;       // frames per ring
+
+    alignas(64) std::atomic<uint32_t> inHead;    // advanced by the client after writing a frame
+    alignas(64) std::atomic<uint32_t> inTail;    // advanced by the server after consuming a frame
+    alignas(64) std::atomic<uint32_t> outHead;   // advanced by the server after writing a frame
+    alignas(64) std::atomic<uint32_t> outTail;   // advanced by the client after consuming a frame
+    alignas(64) std::atomic<uint32_t> serverWaiting;
+    alignas(64) std::atomic<uint32_t> clientWaiting;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory rings need address-free atomics");
+
+// Total size of a region holding both rings.
+inline std::size_t shm_region_size(uint32_t frameBytes, uint32_t capacity) {
+    return sizeof(shm_ring_header) + 2 * static_cast<std::size_t>(frameBytes) * capacity;
+}
+
+//
+// View over a mapped region. Producer and consumer operations for both directions; each side
+// only uses the half that belongs to it. The geometry is fixed at construction and never re-read
+// from the mapping, and the server only maps regions sealed against shrinking (F_SEAL_SHRINK), so
+// a misbehaving peer can corrupt indices but cannot move accesses outside it.
+//
+class shm_ring {
+public:
+    shm_ring(void* base, uint32_t frameBytes, uint32_t capacity)
+        : header_(static_cast<shm_ring_header*>(base)),
+          frameBytes_(frameBytes),
+          capacity_(capacity),
+          in_(static_cast<char*>(base) + sizeof(shm_ring_header)),
+          out_(in_ + static_cast<std::size_t>(frameBytes) * capacity)
+    {
+    }
+
+    // Initializes an empty region (client side, before handing it to the server).
+    static void init(void* base, uint32_t frameBytes, uint32_t capacity) {
+        auto* h = new (base) shm_ring_header{};
+        h->magic = shm_ring_header::magic_value;
+        h->version = shm_ring_header::version_value;
+        h->frameBytes = frameBytes;
+        h->capacity = capacity;
+    }
+
+    // Validates a region received from a peer against the size actually mapped and returns its
+    // ring capacity. Each field is read once, so later writes by the peer cannot bypass the checks.
+    static bool validate(const void* base, std::size_t mappedBytes, uint32_t expectedFrameBytes, uint32_t& capacity) {
+        if (mappedBytes < sizeof(shm_ring_header))
+            return false;
+        auto* h = static_cast<const volatile shm_ring_header*>(base);
+        uint32_t magic = h->magic;
+        uint32_t version = h->version;
+        uint32_t frameBytes = h->frameBytes;
+        capacity = h->capacity;
+        return magic == shm_ring_header::magic_value && version == shm_ring_header::version_value &&
+               frameBytes == expectedFrameBytes && capacity > 0 &&
+               capacity <= shm_ring_header::max_capacity && (capacity & (capacity - 1)) == 0 &&
+               shm_region_size(frameBytes, capacity) <= mappedBytes;
+    }
+
+    uint32_t capacity() const { return capacity_; }
+
+    shm_ring_header& header() { return *header_; }
+
+    // "in" ring: client produces, server consumes.
+    std::size_t in_available() const {
+        return bounded(header_->inHead.load(std::memory_order_acquire) - header_->inTail.load(std::memory_order_relaxed));
+    }
+    std::size_t in_free() const {
+        return capacity_ - bounded(header_->inHead.load(std::memory_order_relaxed) -
+                                   header_->inTail.load(std::memory_order_acquire));
+    }
+    const char* in_front() const { return slot(in_, header_->inTail.load(std::memory_order_relaxed)); }
+    void in_pop() { header_->inTail.fetch_add(1, std::memory_order_release); }
+    char* in_back() { return slot(in_, header_->inHead.load(std::memory_order_relaxed)); }
+    void in_push() { header_->inHead.fetch_add(1, std::memory_order_release); }
+
+    // "out" ring: server produces, client consumes.
+    std::size_t out_available() const {
+        return bounded(header_->outHead.load(std::memory_order_acquire) - header_->outTail.load(std::memory_order_relaxed));
+    }
+    std::size_t out_free() const {
+        return capacity_ - bounded(header_->outHead.load(std::memory_order_relaxed) -
+                                   header_->outTail.load(std::memory_order_acquire));
+    }
+    const char* out_front() const { return slot(out_, header_->outTail.load(std::memory_order_relaxed)); }
+    void out_pop() { header_->outTail.fetch_add(1, std::memory_order_release); }
+    char* out_back() { return slot(out_, header_->outHead.load(std::memory_order_relaxed)); }
+    void out_push() { header_->outHead.fetch_add(1, std::memory_order_release); }
+
+private:
+    std::size_t bounded(uint32_t count) const {
+        return count > capacity_ ? capacity_ : count;
+    }
+    char* slot(char* ring, uint32_t index) const {
+        return ring + static_cast<std::size_t>(index % capacity_) * frameBytes_;
+    }
+    const char* slot(const char* ring, uint32_t index) const {
+        return ring + static_cast<std::size_t>(index % capacity_) * frameBytes_;
+    }
+
+    shm_ring_header* header_;
+    uint32_t frameBytes_;
+    uint32_t capacity_;
+    char* in_;
+    char* out_;
+};
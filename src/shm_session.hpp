@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+
+#include "admission.hpp"
+#include "alloc_counter.hpp"
+#include "drain_control.hpp"
+#include "handler_memory.hpp"
+#include "logging.hpp"
+#include "nc_pipeline.hpp"
+#include "session_control.hpp"
+#include "shm_ring.hpp"
+#include "usage_accounting.hpp"
+
+//
+// shm_session: one shared-memory stream for a co-located client (see shm_ring.hpp for the layout).
+// The session receives the region and eventfds over its Unix-socket control connection, then
+// waits on the client's eventfd in the io_context, drains every available input frame in place
+// into the output ring and wakes the client only if it is sleeping. After attach, the client may
+// send session_control commands on the control connection, one per line, and gets one answer
+// line each. Closing the control connection ends the stream; when the server drains, it sends
+// drain_notice_text as a line of its own on it.
+//
+// The attach message's payload is a single zero byte, or the stream's tenant and call as
+// "tenant=acme call=4711" (see stream_identity); usage is billed to that tenant, with the
+// wake-up and control handlers metered as I/O time.
+//
+class shm_session : public std::enable_shared_from_this<shm_session>, private drain_listener {
+public:
+    using unix_socket = boost::asio::local::stream_protocol;
+
+    shm_session(unix_socket::socket control, const std::string& model_path, float noiseSuppressionLevel,
+                drain_control& drain, admission_control& admission, tap_writer& taps, std::atomic<int>& totalCount)
+        : control_(std::move(control)),
+          strand_(make_session_strand(control_.get_executor())),
+          wakeup_(control_.get_executor()),
+          drain_(drain),
+          slot_(admission),
+          totalConnections_(totalCount)
+    {
+        // The server reserved this session's slot before constructing it.
+        log_info("New shared-memory stream accepted | Active: " + std::to_string(slot_.active()) +
+                 " | Total: " + std::to_string(totalConnections_.load()));
+
+        // Create a dedicated Krisp session for this stream.
+        ncSession_ = std::make_unique<nc_pipeline>(model_path, nc_pipeline::SamplingRate::Sr16000Hz,
+                                                   noiseSuppressionLevel);
+        ncSession_->attach_tap(taps, "shm");
+        drain_.join(*this);
+    }
+
+    ~shm_session() {
+        slot_.release();
+        log_info("Shared-memory stream closed | Frames: " + std::to_string(frames_) +
+                 " | Wake-ups: " + std::to_string(wakeups_) +
+                 " | Active: " + std::to_string(slot_.active()) +
+                 " | Total: " + std::to_string(totalConnections_.load()));
+
+        ncSession_->print_stats();
+#ifdef APM_COUNT_ALLOCATIONS
+        log_info("Steady-state heap allocations (shared memory): " + std::to_string(probe_.steady_allocations()) +
+                 " over " + std::to_string(probe_.steady_frames()) + " frames");
+#endif
+        ncSession_.reset();
+        if (region_ != nullptr) {
+            munmap(region_, regionSize_);
+        }
+        if (notifyFd_ >= 0) {
+            close(notifyFd_);
+        }
+        drain_.leave(*this);
+    }
+
+    // Tells a client the server has no slot for it: busy_notice_byte in place of the attach
+    // acknowledgement, then close.
+    static void reject_busy(unix_socket::socket& control) {
+        boost::system::error_code ignored;
+        boost::asio::write(control, boost::asio::buffer(&busy_notice_byte, 1), ignored);
+        control.close(ignored);
+    }
+
+    void start() {
+        auto self(shared_from_this());
+        control_.async_wait(unix_socket::socket::wait_read,
+            boost::asio::bind_executor(strand_,
+                [this, self](boost::system::error_code ec) {
+                    if (!ec && attach()) {
+                        watch_control();
+                        // Drain once so serverWaiting is published before the client's first frame.
+                        drain();
+                        do_wait_input(self);
+                    }
+                }
+            )
+        );
+    }
+
+private:
+    // Receives [memfd, input eventfd, output eventfd] and maps the region. Acknowledges with one
+    // byte on the control connection so the client knows the server is attached.
+    bool attach() {
+        // The payload arrives whole: a stream socket does not merge data sent with descriptors
+        // into a read of the data sent after it.
+        std::array<char, 256> payload{};
+        iovec iov{payload.data(), payload.size()};
+        alignas(cmsghdr) std::array<char, CMSG_SPACE(3 * sizeof(int))> control{};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        ssize_t n = recvmsg(control_.native_handle(), &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+        int fds[3] = {-1, -1, -1};
+        std::size_t received = 0;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                received = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                std::memcpy(fds, CMSG_DATA(c), std::min<std::size_t>(received, 3) * sizeof(int));
+            }
+        }
+        auto fail = [&](const std::string& why) {
+            log_error("Shared-memory attach failed: " + why);
+            for (std::size_t i = 0; i < std::min<std::size_t>(received, 3); ++i) {
+                close(fds[i]);
+            }
+            return false;
+        };
+        if (n <= 0 || received != 3 || (msg.msg_flags & MSG_CTRUNC) != 0) {
+            return fail("expected a memfd and two eventfds");
+        }
+        std::string text(payload.data(), static_cast<std::size_t>(n));
+        text.erase(text.find_last_not_of(std::string("\n\0", 2)) + 1);
+        stream_identity identity;
+        if (!text.empty() && !identity.parse(text)) {
+            return fail("malformed tenant or call id");
+        }
+
+        // An unsealed region could be truncated by the client while mapped, and the next access
+        // past its new end would kill the server with SIGBUS.
+        int seals = fcntl(fds[0], F_GET_SEALS);
+        if (seals < 0 || (seals & F_SEAL_SHRINK) == 0) {
+            return fail("shared memory region is not sealed against shrinking (F_SEAL_SHRINK)");
+        }
+        if (!is_eventfd(fds[1]) || !is_eventfd(fds[2])) {
+            return fail("wake-up descriptors are not eventfds");
+        }
+        struct stat st{};
+        if (fstat(fds[0], &st) != 0 || st.st_size <= 0) {
+            return fail("cannot stat shared memory region");
+        }
+        regionSize_ = static_cast<std::size_t>(st.st_size);
+        void* region = mmap(nullptr, regionSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        close(fds[0]);
+        fds[0] = -1;
+        if (region == MAP_FAILED) {
+            return fail("mmap: " + std::string(std::strerror(errno)));
+        }
+        region_ = region;
+
+        uint32_t capacity = 0;
+        auto frameBytes = static_cast<uint32_t>(ncSession_->frame_samples() * sizeof(int16_t));
+        if (!shm_ring::validate(region_, regionSize_, frameBytes, capacity)) {
+            return fail("invalid region header");
+        }
+        ring_ = std::make_unique<shm_ring>(region_, frameBytes, capacity);
+        wakeup_.assign(fds[1]);
+        notifyFd_ = fds[2];
+
+        char ack = 0;
+        boost::system::error_code ec;
+        boost::asio::write(control_, boost::asio::buffer(&ack, 1), ec);
+        if (ec) {
+            log_error("Shared-memory attach failed: " + ec.message());
+            return false;
+        }
+        if (!text.empty()) {
+            ncSession_->usage().identify(identity);
+        }
+        log_info("Shared-memory stream attached | Ring: " + std::to_string(capacity) + " frames" +
+                 (text.empty() ? "" : " | Tenant: " + identity.tenant +
+                                      (identity.call.empty() ? "" : " | Call: " + identity.call)));
+        return true;
+    }
+
+    // Eventfds have no file type of their own; the kernel names them in /proc.
+    static bool is_eventfd(int fd) {
+        char link[64];
+        std::string path = "/proc/self/fd/" + std::to_string(fd);
+        ssize_t n = readlink(path.c_str(), link, sizeof(link));
+        return n > 0 && std::string(link, static_cast<std::size_t>(n)) == "anon_inode:[eventfd]";
+    }
+
+    void on_drain() override {
+        auto self = weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(strand_, [this, self]() {
+            if (ring_ == nullptr || !control_.is_open()) {
+                return;
+            }
+            send_line(std::string(drain_notice_text) + "\n");
+        });
+    }
+
+    void on_drain_timeout() override {
+        auto self = weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(strand_, [this, self]() {
+            boost::system::error_code ignored;
+            wakeup_.close(ignored);
+            control_.close(ignored);
+        });
+    }
+
+    // Longest control command line accepted; a longer one closes the stream.
+    static constexpr std::size_t max_command_size = 4096;
+
+    // Reads control commands until the client closes the control connection, which ends the
+    // stream. Commands run on the strand, between drains, so they never race the processing.
+    // The next command is only read once the reply has been written, so a client that does not
+    // read its replies stops being read instead of making the server buffer them.
+    void watch_control() {
+        auto self(shared_from_this());
+        boost::asio::async_read_until(control_, boost::asio::dynamic_buffer(command_, max_command_size), '\n',
+            boost::asio::bind_executor(strand_, metered(ncSession_->usage(),
+                [this, self](boost::system::error_code ec, std::size_t n) {
+                    if (ec) {
+                        boost::system::error_code ignored;
+                        wakeup_.close(ignored);
+                        control_.close(ignored);
+                        return;
+                    }
+                    std::string reply = session_control::apply(*ncSession_, command_.substr(0, n - 1)) + "\n";
+                    command_.erase(0, n);
+                    awaitingReply_ = true;
+                    send_line(reply);
+                }
+            ))
+        );
+    }
+
+    // Queues one line for the client. Lines go out in order, one asynchronous write at a time,
+    // so a client that stopped reading never blocks the io thread.
+    void send_line(const std::string& line) {
+        outbox_ += line;
+        if (!writing_) {
+            write_outbox();
+        }
+    }
+
+    void write_outbox() {
+        writing_ = true;
+        sending_.swap(outbox_);
+        boost::asio::async_write(control_, boost::asio::buffer(sending_),
+            boost::asio::bind_executor(strand_, metered(ncSession_->usage(),
+                [this, self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+                    writing_ = false;
+                    sending_.clear();
+                    if (ec) {
+                        if (ec != boost::asio::error::operation_aborted) {
+                            log_error("Shared-memory control reply failed: " + ec.message());
+                        }
+                        boost::system::error_code ignored;
+                        wakeup_.close(ignored);
+                        control_.close(ignored);
+                        return;
+                    }
+                    if (!outbox_.empty()) {
+                        write_outbox();
+                    } else if (awaitingReply_) {
+                        awaitingReply_ = false;
+                        watch_control();
+                    }
+                }
+            ))
+        );
+    }
+
+    // Like the stream sessions, the wake-up chain moves its reference along and allocates its
+    // operation from recycled handler memory, so a wake-up costs no heap or refcount traffic.
+    void do_wait_input(std::shared_ptr<shm_session> self) {
+        wakeup_.async_read_some(boost::asio::buffer(&wakeupCount_, sizeof(wakeupCount_)),
+            boost::asio::bind_executor(strand_, make_custom_alloc_handler(wakeupMemory_, metered(ncSession_->usage(),
+                [this, self = std::move(self)](boost::system::error_code ec, std::size_t) mutable {
+                    if (!ec) {
+                        ++wakeups_;
+                        drain();
+                        do_wait_input(std::move(self));
+                    }
+                }
+            )))
+        );
+    }
+
+    // Processes at most one ring's worth of frames per call, so a client that keeps both rings
+    // busy cannot hold the io thread. When frames are still waiting after that, the rest runs in
+    // a continuation posted to the strand, behind whatever else is queued.
+    void drain() {
+        auto& header = ring_->header();
+        std::size_t budget = ring_->capacity();
+        for (;;) {
+            header.serverWaiting.store(0, std::memory_order_relaxed);
+            std::size_t n = std::min({ring_->in_available(), ring_->out_free(), budget});
+            for (std::size_t i = 0; i < n; ++i) {
+                ncSession_->process(reinterpret_cast<const int16_t*>(ring_->in_front()),
+                                    reinterpret_cast<int16_t*>(ring_->out_back()));
+                ring_->in_pop();
+                ring_->out_push();
+                probe_.on_frame();
+            }
+            frames_ += n;
+            budget -= n;
+            if (n > 0) {
+                notify_client();
+            }
+            if (budget == 0) {
+                // Stay awake (serverWaiting is 0) so the client does not signal a continuation
+                // that is already coming.
+                if (ring_->in_available() > 0 && ring_->out_free() > 0) {
+                    continue_drain();
+                    return;
+                }
+            }
+
+            // Announce that we are going to sleep, then re-check: a frame pushed (or an output
+            // slot freed) before the client saw the flag would otherwise never wake us.
+            header.serverWaiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring_->in_available() == 0 || ring_->out_free() == 0) {
+                return;
+            }
+            if (budget == 0) {
+                continue_drain();
+                return;
+            }
+        }
+    }
+
+    void continue_drain() {
+        if (drainPending_) {
+            return;
+        }
+        drainPending_ = true;
+        boost::asio::post(strand_, make_custom_alloc_handler(drainMemory_, metered(ncSession_->usage(),
+            [this, self = shared_from_this()]() {
+                drainPending_ = false;
+                if (control_.is_open()) {
+                    drain();
+                }
+            }
+        )));
+    }
+
+    void notify_client() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring_->header().clientWaiting.load(std::memory_order_relaxed) != 0) {
+            uint64_t one = 1;
+            if (write(notifyFd_, &one, sizeof(one)) < 0) {
+                log_error("Shared-memory notify failed: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+
+    unix_socket::socket control_;
+    session_strand strand_;
+    boost::asio::posix::stream_descriptor wakeup_;
+    handler_memory wakeupMemory_;
+    handler_memory drainMemory_;
+    bool drainPending_ = false;
+    drain_control& drain_;
+    std::string command_;
+    std::string outbox_;            // lines queued while a write is in flight
+    std::string sending_;           // the lines of the write in flight
+    bool writing_ = false;
+    bool awaitingReply_ = false;    // the command chain resumes once its reply is written
+    uint64_t wakeupCount_ = 0;
+    int notifyFd_ = -1;
+    void* region_ = nullptr;
+    std::size_t regionSize_ = 0;
+    std::unique_ptr<shm_ring> ring_;
+    std::unique_ptr<nc_pipeline> ncSession_;
+    hot_path_probe probe_;
+    uint64_t frames_ = 0;
+    uint64_t wakeups_ = 0;
+    admission_slot slot_;
+    std::atomic<int>& totalConnections_;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+//
+// slab_pool: fixed-size block pool for long-lived, frequently recycled objects (sessions).
+//
+// Blocks are carved out of slabs of blocks_per_slab blocks, each block rounded up to a whole
+// number of cache lines and cache-line aligned, so two sessions never share a line. Freed
+// blocks go on a LIFO free list and are reused hot; slabs are never returned, so under
+// connect/disconnect churn the heap is not fragmented and RSS stays at the peak concurrency.
+// New slabs are zero-filled by the allocating thread, which first-touches their pages and so
+// places them on that thread's NUMA node.
+//
+// The block size is fixed by the first allocation; larger requests fall back to the heap.
+//
+class slab_pool {
+public:
+    static constexpr std::size_t cache_line = 64;
+    static constexpr std::size_t blocks_per_slab = 16;
+
+    slab_pool() = default;
+    slab_pool(const slab_pool&) = delete;
+    slab_pool& operator=(const slab_pool&) = delete;
+
+    void* allocate(std::size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (blockSize_ == 0) {
+            blockSize_ = (size + cache_line - 1) / cache_line * cache_line;
+        }
+        if (size > blockSize_) {
+            ++heapFallbacks_;
+            return ::operator new(size, std::align_val_t(cache_line));
+        }
+        if (freeList_ == nullptr) {
+            add_slab();
+        }
+        free_block* block = freeList_;
+        freeList_ = block->next;
+        ++inUse_;
+        return block;
+    }
+
+    void deallocate(void* pointer, std::size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (size > blockSize_) {
+            ::operator delete(pointer, std::align_val_t(cache_line));
+            return;
+        }
+        auto* block = static_cast<free_block*>(pointer);
+        block->next = freeList_;
+        freeList_ = block;
+        --inUse_;
+    }
+
+    struct stats {
+        std::size_t blockSize;
+        std::size_t slabs;
+        std::size_t inUse;
+        std::size_t heapFallbacks;
+    };
+
+    stats get_stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats{blockSize_, slabs_.size(), inUse_, heapFallbacks_};
+    }
+
+private:
+    struct free_block {
+        free_block* next;
+    };
+
+    struct slab_deleter {
+        void operator()(char* slab) const {
+            ::operator delete[](slab, std::align_val_t(cache_line));
+        }
+    };
+
+    void add_slab() {
+        std::size_t bytes = blockSize_ * blocks_per_slab;
+        std::unique_ptr<char[], slab_deleter> slab(
+            static_cast<char*>(::operator new[](bytes, std::align_val_t(cache_line))));
+        std::memset(slab.get(), 0, bytes);
+        // Thread the blocks so the lowest address is handed out first.
+        for (std::size_t i = blocks_per_slab; i-- > 0;) {
+            auto* block = reinterpret_cast<free_block*>(slab.get() + i * blockSize_);
+            block->next = freeList_;
+            freeList_ = block;
+        }
+        slabs_.push_back(std::move(slab));
+    }
+
+    std::mutex mutex_;
+    std::size_t blockSize_ = 0;
+    std::size_t inUse_ = 0;
+    std::size_t heapFallbacks_ = 0;
+    free_block* freeList_ = nullptr;
+    std::vector<std::unique_ptr<char[], slab_deleter>> slabs_;
+};
+
+//
+// Pool for objects of type T, created on first use. It is intentionally never destroyed:
+// sessions still referenced by pending handlers are released while the io_context is torn
+// down, which can happen after the owner of any non-leaked pool is gone.
+//
+template <typename T>
+inline slab_pool& slab_pool_for() {
+    static slab_pool* pool = new slab_pool();
+    return *pool;
+}
+
+// Standard allocator over a slab_pool, for std::allocate_shared (object and control block
+// then share one pooled block).
+template <typename T>
+class slab_allocator {
+public:
+    using value_type = T;
+
+    explicit slab_allocator(slab_pool& pool) noexcept : pool_(&pool) {}
+
+    template <typename U>
+    slab_allocator(const slab_allocator<U>& other) noexcept : pool_(other.pool_) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n) noexcept {
+        pool_->deallocate(pointer, n * sizeof(T));
+    }
+
+    bool operator==(const slab_allocator& other) const noexcept { return pool_ == other.pool_; }
+    bool operator!=(const slab_allocator& other) const noexcept { return pool_ != other.pool_; }
+
+private:
+    template <typename> friend class slab_allocator;
+    slab_pool* pool_;
+};
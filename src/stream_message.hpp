@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//
+// Messages of a framed TCP or Unix-socket stream (framed=1 in the handshake), in both
+// directions. Every message is a three-byte header, the type and the payload length as a
+// little-endian uint16, followed by the payload:
+//   'A'  audio: PCM16 bytes of any length. Payloads are joined into one byte stream, so frames
+//        need not line up with messages.
+//   'C'  control: one JSON object; a session_control command from the client, or a reply or
+//        event ({"event":"drain"}, ...) from the server.
+//
+namespace stream_message {
+
+constexpr std::size_t header_size = 3;
+constexpr std::size_t max_payload = 0xFFFF;
+constexpr char audio = 'A';
+constexpr char control = 'C';
+
+inline void write_header(char* header, char type, std::size_t length) {
+    header[0] = type;
+    header[1] = static_cast<char>(length & 0xFF);
+    header[2] = static_cast<char>(length >> 8 & 0xFF);
+}
+
+// A complete control message holding json, which must fit max_payload.
+inline std::string control_message(const std::string& json) {
+    std::string message(header_size, '\0');
+    write_header(&message[0], control, json.size());
+    return message + json;
+}
+
+}
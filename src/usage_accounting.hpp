@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "logging.hpp"
+
+//
+// Who a stream belongs to, from its connection handshake. Both ids are optional; streams
+// without them are billed to default_tenant. The handshake may also ask for session resume
+// (see session_park.hpp): resume=new asks for a resume token, resume=TOKEN continues the
+// stream parked under it. framed=1 switches a byte stream's input to framed messages, so it can
+// carry control commands next to the audio (see session_control::stream_demux).
+//
+struct stream_identity {
+    static constexpr std::size_t max_id_length = 64;
+    static constexpr const char* default_tenant = "-";
+
+    std::string tenant = default_tenant;
+    std::string call;
+    std::string resume;     // empty when the client does not use resume
+    bool framed = false;
+
+    // Parses "tenant=ID call=ID resume=TOKEN framed=0|1" (any order, each optional, separated by spaces, '&' or
+    // ';', so the same text works as a URL query). Ids are 1 to max_id_length characters of
+    // [A-Za-z0-9._:@-]. Returns false, leaving the identity unchanged, on anything else.
+    bool parse(const std::string& text) {
+        stream_identity parsed;
+        std::size_t pos = 0;
+        while (pos < text.size()) {
+            std::size_t end = text.find_first_of(" &;\r\n", pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::string item = text.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty()) {
+                continue;
+            }
+            std::size_t eq = item.find('=');
+            if (eq == std::string::npos || !valid_id(item.substr(eq + 1))) {
+                return false;
+            }
+            std::string key = item.substr(0, eq);
+            if (key == "tenant") {
+                parsed.tenant = item.substr(eq + 1);
+            } else if (key == "call") {
+                parsed.call = item.substr(eq + 1);
+            } else if (key == "resume") {
+                parsed.resume = item.substr(eq + 1);
+            } else if (key == "framed" && (item.substr(eq + 1) == "0" || item.substr(eq + 1) == "1")) {
+                parsed.framed = item.substr(eq + 1) == "1";
+            } else {
+                return false;
+            }
+        }
+        *this = std::move(parsed);
+        return true;
+    }
+
+    static bool valid_id(const std::string& id) {
+        if (id.empty() || id.size() > max_id_length) {
+            return false;
+        }
+        return std::all_of(id.begin(), id.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == ':' ||
+                   c == '@' || c == '-';
+        });
+    }
+};
+
+//
+// The handshake line a byte-stream client (TCP or Unix socket) may send before its audio:
+//
+//   APM/1 tenant=acme call=4711\n
+//
+// Reads it from the start of data; returns its length including the newline, 0 when the stream
+// starts with audio instead, handshake_malformed, or handshake_incomplete when data so far is
+// the start of a handshake line without its newline.
+//
+constexpr char handshake_prefix[] = "APM/1 ";
+constexpr long handshake_malformed = -1;
+constexpr long handshake_incomplete = -2;
+
+inline long read_handshake(const char* data, std::size_t size, stream_identity& identity) {
+    constexpr std::size_t prefix = sizeof(handshake_prefix) - 1;
+    if (std::memcmp(data, handshake_prefix, std::min(size, prefix)) != 0) {
+        return 0;
+    }
+    if (size <= prefix) {
+        return handshake_incomplete;
+    }
+    const char* end = static_cast<const char*>(std::memchr(data, '\n', size));
+    if (end == nullptr) {
+        return handshake_incomplete;
+    }
+    if (!identity.parse(std::string(data + prefix, end))) {
+        return handshake_malformed;
+    }
+    return static_cast<long>(end - data) + 1;
+}
+
+//
+// Wall-clock and, when asked for, thread-CPU time at one instant, in nanoseconds. The thread
+// clock is read with clock_gettime(CLOCK_THREAD_CPUTIME_ID), so time the thread spent preempted
+// or blocked is wall time but not CPU time. Unlike the monotonic clock that read is not served
+// by the vDSO but is a system call, so the accounting only takes it for one in
+// cpu_sample_interval measurements (see cpu_estimate); cpuNs is -1 otherwise.
+//
+struct cpu_sample {
+    static constexpr uint32_t cpu_sample_interval = 16;
+
+    int64_t wallNs;
+    int64_t cpuNs;
+
+    static cpu_sample now(bool withCpu) {
+        timespec wall{}, cpu{};
+        clock_gettime(CLOCK_MONOTONIC, &wall);
+        if (withCpu) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        }
+        return cpu_sample{static_cast<int64_t>(wall.tv_sec) * 1000000000 + wall.tv_nsec,
+                          withCpu ? static_cast<int64_t>(cpu.tv_sec) * 1000000000 + cpu.tv_nsec : -1};
+    }
+};
+
+//
+// The CPU time of one kind of measurement (a stream's processing, or its I/O handlers): every
+// cpu_sample_interval-th measurement reads the thread clock, and the others are billed their
+// wall time scaled by the CPU share of the sampled ones so far. Used by a single writer.
+//
+class cpu_estimate {
+public:
+    // Whether the next measurement should read the thread clock.
+    bool sample_next() {
+        return count_++ % cpu_sample::cpu_sample_interval == 0;
+    }
+
+    // The CPU time to bill for a measurement of wallNs; cpuNs is the measured time of a sampled
+    // one, or negative.
+    int64_t bill(int64_t wallNs, int64_t cpuNs) {
+        if (cpuNs >= 0) {
+            sampledWallNs_ += wallNs;
+            sampledCpuNs_ += cpuNs;
+            return cpuNs;
+        }
+        if (sampledWallNs_ <= 0) {
+            return wallNs;
+        }
+        return static_cast<int64_t>(static_cast<double>(wallNs) * static_cast<double>(sampledCpuNs_) /
+                                    static_cast<double>(sampledWallNs_));
+    }
+
+private:
+    uint32_t count_ = 0;
+    int64_t sampledWallNs_ = 0;
+    int64_t sampledCpuNs_ = 0;
+};
+
+//
+// Counters of one tenant: streams, frames and the time spent in Nc::process ("nc") and in the
+// transports' I/O handlers ("io", excluding any processing done inside them).
+//
+struct usage_counters {
+    std::atomic<uint64_t> sessions{0};
+    std::atomic<int64_t> active{0};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<int64_t> ncWallNs{0};
+    std::atomic<int64_t> ncCpuNs{0};
+    std::atomic<int64_t> ioWallNs{0};
+    std::atomic<int64_t> ioCpuNs{0};
+};
+
+//
+// usage_registry: per-tenant totals for billing and capacity planning, served on the admin
+// endpoint (GET /usage) and logged at shutdown. Tenants are kept for the life of the process;
+// past max_tenants distinct ids, new ones are billed to overflow_tenant so a misbehaving
+// client cannot grow the map without bound.
+//
+class usage_registry {
+public:
+    static constexpr std::size_t max_tenants = 1024;
+    static constexpr const char* overflow_tenant = "other";
+
+    std::shared_ptr<usage_counters> account(const std::string& tenant) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = tenants_.find(tenant);
+        if (it != tenants_.end()) {
+            return it->second;
+        }
+        if (tenants_.size() >= max_tenants) {
+            if (!overflowLogged_) {
+                overflowLogged_ = true;
+                log_error("Usage: more than " + std::to_string(max_tenants) + " tenants; new ones are counted as " +
+                          overflow_tenant);
+            }
+            auto& other = tenants_[overflow_tenant];
+            if (!other) {
+                other = std::make_shared<usage_counters>();
+            }
+            return other;
+        }
+        auto counters = std::make_shared<usage_counters>();
+        tenants_.emplace(tenant, counters);
+        return counters;
+    }
+
+    std::string json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string body = "{\"tenants\":[";
+        bool first = true;
+        for (auto& entry : tenants_) {
+            auto& c = *entry.second;
+            body += std::string(first ? "" : ",") + "{\"tenant\":\"" + entry.first + "\"" +
+                    ",\"sessions\":" + std::to_string(c.sessions.load()) +
+                    ",\"active\":" + std::to_string(c.active.load()) +
+                    ",\"frames\":" + std::to_string(c.frames.load()) +
+                    ",\"nc_wall_ms\":" + ms(c.ncWallNs.load()) +
+                    ",\"nc_cpu_ms\":" + ms(c.ncCpuNs.load()) +
+                    ",\"io_wall_ms\":" + ms(c.ioWallNs.load()) +
+                    ",\"io_cpu_ms\":" + ms(c.ioCpuNs.load()) + "}";
+            first = false;
+        }
+        return body + "]}\n";
+    }
+
+    void print_stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tenants_.empty()) {
+            return;
+        }
+        std::string text = "#--- Usage by tenant ---";
+        for (auto& entry : tenants_) {
+            auto& c = *entry.second;
+            text += "\n# - " + entry.first + ": " + std::to_string(c.sessions.load()) + " sessions, " +
+                    std::to_string(c.frames.load()) + " frames | NC: " + ms(c.ncCpuNs.load()) + " ms CPU, " +
+                    ms(c.ncWallNs.load()) + " ms wall | I/O: " + ms(c.ioCpuNs.load()) + " ms CPU, " +
+                    ms(c.ioWallNs.load()) + " ms wall";
+        }
+        log_info(text);
+    }
+
+    static std::string ms(int64_t ns) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(ns) / 1e6);
+        return text;
+    }
+
+private:
+    std::mutex mutex_;      // guards tenants_; the counters themselves are atomics
+    std::map<std::string, std::shared_ptr<usage_counters>> tenants_;
+    bool overflowLogged_ = false;
+};
+
+//
+// The process-wide registry; leaked like the tracer, so sessions torn down at exit can still
+// settle their accounts.
+//
+inline usage_registry& usage() {
+    static usage_registry* instance = new usage_registry();
+    return *instance;
+}
+
+//
+// session_usage: the time one stream has used, billed to its tenant as it accrues so the
+// registry also covers streams still running. A stream is counted from its handshake or its
+// first handler or frame, whichever comes first (so the pipeline that probes the model at
+// startup is never billed); without a handshake it is billed to default_tenant. A handshake
+// after that moves the stream, with everything it used so far, to the tenant it names.
+//
+// NC time is added by the stream's processing path and I/O time by its handlers; each field
+// has a single writer, and the fields are atomics so a batch on another thread and a handler may
+// update the same stream. The first use always happens on the stream's own path, before any
+// batch is submitted for it.
+//
+class session_usage {
+public:
+    session_usage() = default;
+
+    ~session_usage() {
+        if (account_) {
+            account_->active.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    session_usage(const session_usage&) = delete;
+    session_usage& operator=(const session_usage&) = delete;
+
+    void identify(const stream_identity& identity) {
+        identity_ = identity;
+        auto next = usage().account(identity.tenant);
+        if (next == account_) {
+            return;
+        }
+        if (account_) {
+            move_totals(*account_, -1);
+        }
+        move_totals(*next, 1);
+        account_ = std::move(next);
+    }
+
+    const stream_identity& identity() const {
+        return identity_;
+    }
+
+    // Whether the next processing measurement reads the thread clock (see cpu_estimate).
+    bool sample_nc_cpu() {
+        return ncCpu_.sample_next();
+    }
+
+    bool sample_io_cpu() {
+        return ioCpu_.sample_next();
+    }
+
+    // Both samples must have been taken with the sample_nc_cpu() answer of this measurement.
+    void add_nc(const cpu_sample& begin, const cpu_sample& end) {
+        usage_counters& tenant = account();
+        int64_t wallNs = end.wallNs - begin.wallNs;
+        add(ncWallNs_, tenant.ncWallNs, wallNs);
+        add(ncCpuNs_, tenant.ncCpuNs, ncCpu_.bill(wallNs, begin.cpuNs < 0 ? -1 : end.cpuNs - begin.cpuNs));
+        frames_.fetch_add(1, std::memory_order_relaxed);
+        tenant.frames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // cpuNs is negative when the handler was not sampled (see sample_io_cpu()).
+    void add_io(int64_t wallNs, int64_t cpuNs) {
+        usage_counters& tenant = account();
+        wallNs = std::max<int64_t>(0, wallNs);
+        add(ioWallNs_, tenant.ioWallNs, wallNs);
+        add(ioCpuNs_, tenant.ioCpuNs, ioCpu_.bill(wallNs, cpuNs < 0 ? -1 : cpuNs));
+    }
+
+    int64_t nc_wall_ns() const { return ncWallNs_.load(std::memory_order_relaxed); }
+    int64_t nc_cpu_ns() const { return ncCpuNs_.load(std::memory_order_relaxed); }
+    int64_t io_wall_ns() const { return ioWallNs_.load(std::memory_order_relaxed); }
+    int64_t io_cpu_ns() const { return ioCpuNs_.load(std::memory_order_relaxed); }
+
+    std::string summary() const {
+        return "Tenant: " + identity_.tenant + (identity_.call.empty() ? "" : " | Call: " + identity_.call) +
+               " | NC: " + usage_registry::ms(nc_cpu_ns()) + " ms CPU, " + usage_registry::ms(nc_wall_ns()) +
+               " ms wall | I/O: " + usage_registry::ms(io_cpu_ns()) + " ms CPU, " +
+               usage_registry::ms(io_wall_ns()) + " ms wall";
+    }
+
+private:
+    usage_counters& account() {
+        if (!account_) {
+            account_ = usage().account(stream_identity::default_tenant);
+            move_totals(*account_, 1);
+        }
+        return *account_;
+    }
+
+    static void add(std::atomic<int64_t>& mine, std::atomic<int64_t>& tenant, int64_t ns) {
+        mine.store(mine.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        tenant.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // Adds (sign 1) or removes (sign -1) this stream's totals to or from a tenant.
+    void move_totals(usage_counters& c, int sign) {
+        c.sessions.fetch_add(static_cast<uint64_t>(sign), std::memory_order_relaxed);
+        c.active.fetch_add(sign, std::memory_order_relaxed);
+        c.frames.fetch_add(static_cast<uint64_t>(sign) * frames_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        c.ncWallNs.fetch_add(sign * nc_wall_ns(), std::memory_order_relaxed);
+        c.ncCpuNs.fetch_add(sign * nc_cpu_ns(), std::memory_order_relaxed);
+        c.ioWallNs.fetch_add(sign * io_wall_ns(), std::memory_order_relaxed);
+        c.ioCpuNs.fetch_add(sign * io_cpu_ns(), std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<usage_counters> account_;
+    stream_identity identity_;
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<int64_t> ncWallNs_{0};
+    std::atomic<int64_t> ncCpuNs_{0};
+    std::atomic<int64_t> ioWallNs_{0};
+    std::atomic<int64_t> ioCpuNs_{0};
+    cpu_estimate ncCpu_;    // written by the processing path only
+    cpu_estimate ioCpu_;    // written by the handlers only
+};
+
+//
+// Times one I/O handler of a stream. Processing done inside the handler is already billed as NC
+// time, so it is taken out of the handler's time.
+//
+class io_usage_scope {
+public:
+    explicit io_usage_scope(session_usage& usage)
+        : usage_(usage),
+          begin_(cpu_sample::now(usage.sample_io_cpu())),
+          ncWallNs_(usage.nc_wall_ns()),
+          ncCpuNs_(usage.nc_cpu_ns())
+    {
+    }
+
+    ~io_usage_scope() {
+        bool sampled = begin_.cpuNs >= 0;
+        cpu_sample end = cpu_sample::now(sampled);
+        usage_.add_io(end.wallNs - begin_.wallNs - (usage_.nc_wall_ns() - ncWallNs_),
+                      sampled ? std::max<int64_t>(0, end.cpuNs - begin_.cpuNs - (usage_.nc_cpu_ns() - ncCpuNs_)) : -1);
+    }
+
+    io_usage_scope(const io_usage_scope&) = delete;
+    io_usage_scope& operator=(const io_usage_scope&) = delete;
+
+private:
+    session_usage& usage_;
+    cpu_sample begin_;
+    int64_t ncWallNs_;
+    int64_t ncCpuNs_;
+};
+
+// Wraps a completion handler so its run time is billed as the stream's I/O time. The handler
+// must keep the stream (and so usage) alive while it runs, as every session handler does
+// through its owning reference.
+template <typename Handler>
+auto metered(session_usage& usage, Handler handler) {
+    return [&usage, handler = std::move(handler)](auto&&... args) mutable {
+        io_usage_scope scope(usage);
+        handler(std::forward<decltype(args)>(args)...);
+    };
+}
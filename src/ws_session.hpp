@@ -0,0 +1,387 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include "admission.hpp"
+#include "drain_control.hpp"
+#include "logging.hpp"
+#include "nc_pipeline.hpp"
+#include "peer_name.hpp"
+#include "session_control.hpp"
+#include "usage_accounting.hpp"
+
+//
+// ws_session: handles a single WebSocket connection (16 kHz PCM16, same framing as the TCP port).
+// Every binary message may carry any number of samples: complete 20-ms frames are processed and
+// returned together as one binary reply, and a trailing partial frame is carried over to the next
+// message. An empty binary message marks the end of the stream and flushes the partial frame
+// zero-padded. Text messages carry control: incoming ones are session_control commands, each
+// answered with one text message, and the server sends drain_notice_text when it starts draining.
+// The socket must be created on a strand: Beast runs its internal operations (pings, close
+// handshake, timeouts) on the stream's own executor, so all handlers run on that strand.
+// Beast allows one write at a time, so outgoing text messages queue behind an audio reply in
+// flight and an audio reply waits for queued text. The next message is read only once a
+// command's answer is written, so a client cannot grow the queue.
+//
+// The upgrade request may name the stream's tenant and call, either in its query string
+// (/?tenant=acme&call=4711) or in X-Tenant-Id and X-Call-Id headers; usage is billed to that
+// tenant, with reads and writes metered as I/O time.
+//
+class ws_session : public std::enable_shared_from_this<ws_session>, private drain_listener {
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    // Largest binary message accepted from a client (about 2 s of audio).
+    static constexpr std::size_t max_message_size = 64 * 1024;
+
+    // How long a connection may take to send its upgrade request.
+    static constexpr std::chrono::seconds handshake_timeout{30};
+
+    ws_session(tcp::socket socket, const std::string& model_path, float noiseSuppressionLevel,
+               drain_control& drain, admission_control& admission, tap_writer& taps, std::atomic<int>& totalCount)
+        : ws_(std::move(socket)),
+          handshakeTimer_(ws_.get_executor()),
+          drain_(drain),
+          slot_(admission),
+          totalConnections_(totalCount)
+    {
+        remoteAddress_ = peer_name(ws_.next_layer());
+        // The server reserved this session's slot before constructing it.
+        log_info("New WebSocket connection accepted from " + remoteAddress_ +
+                 " | Active: " + std::to_string(slot_.active()) +
+                 " | Total: " + std::to_string(totalConnections_.load()));
+
+        // Create a dedicated Krisp session for this connection.
+        ncSession_ = std::make_unique<nc_pipeline>(model_path, nc_pipeline::SamplingRate::Sr16000Hz,
+                                                   noiseSuppressionLevel);
+        ncSession_->attach_tap(taps, remoteAddress_);
+        frameBytes_ = ncSession_->frame_samples() * sizeof(int16_t);
+        partial_.resize(frameBytes_);
+        write_buffer_.reserve(max_message_size + frameBytes_);
+        drain_.join(*this);
+    }
+
+    ~ws_session() {
+        slot_.release();
+        log_info("WebSocket connection closed from " + remoteAddress_ +
+                 " | Active: " + std::to_string(slot_.active()) +
+                 " | Total: " + std::to_string(totalConnections_.load()));
+
+        ncSession_->print_stats();
+        ncSession_.reset();
+        drain_.leave(*this);
+    }
+
+    // Answers the upgrade request of a connection the server has no slot for with 503 and a
+    // Retry-After header instead of a WebSocket handshake.
+    static void reject_busy(tcp::socket socket) {
+        namespace http = boost::beast::http;
+        struct busy_response {
+            explicit busy_response(tcp::socket s)
+                : socket(std::move(s)),
+                  timer(socket.get_executor(), std::chrono::seconds(5))
+            {
+            }
+            tcp::socket socket;
+            boost::asio::steady_timer timer;    // bounds the wait for the request
+            boost::beast::flat_buffer buffer;
+            http::request<http::empty_body> request;
+            http::response<http::string_body> response;
+        };
+        auto state = std::make_shared<busy_response>(std::move(socket));
+        state->timer.async_wait([state](boost::system::error_code ec) {
+            if (!ec) {
+                boost::system::error_code ignored;
+                state->socket.close(ignored);
+            }
+        });
+        http::async_read(state->socket, state->buffer, state->request,
+            [state](boost::beast::error_code ec, std::size_t) {
+                if (ec) {
+                    return;
+                }
+                state->response.version(state->request.version());
+                state->response.result(http::status::service_unavailable);
+                state->response.set(http::field::retry_after, "1");
+                state->response.set(http::field::content_type, "text/plain");
+                state->response.keep_alive(false);
+                state->response.body() = "Server busy\n";
+                state->response.prepare_payload();
+                http::async_write(state->socket, state->response,
+                    [state](boost::beast::error_code, std::size_t) {
+                        boost::system::error_code ignored;
+                        state->timer.cancel();
+                        state->socket.shutdown(tcp::socket::shutdown_both, ignored);
+                    }
+                );
+            }
+        );
+    }
+
+    void start() {
+        auto self(shared_from_this());
+        ws_.set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+        ws_.read_message_max(max_message_size);
+        ws_.binary(true);
+        // The upgrade request is read here rather than by the accept, so the handshake can name
+        // the tenant; the timer bounds the wait for it as the accept's own timeout would.
+        handshakeTimer_.expires_after(handshake_timeout);
+        handshakeTimer_.async_wait([this, self](boost::system::error_code ec) {
+            if (!ec) {
+                boost::system::error_code ignored;
+                ws_.next_layer().close(ignored);
+            }
+        });
+        boost::beast::http::async_read(ws_.next_layer(), read_buffer_, request_,
+            [this, self](boost::beast::error_code ec, std::size_t) {
+                handshakeTimer_.cancel();
+                // A client sends nothing after the request before the upgrade is answered.
+                read_buffer_.clear();
+                if (ec) {
+                    log_error("WebSocket handshake error (" + remoteAddress_ + "): " + ec.message());
+                    return;
+                }
+                if (!identify()) {
+                    boost::system::error_code ignored;
+                    ws_.next_layer().close(ignored);
+                    return;
+                }
+                ws_.async_accept(request_,
+                    [this, self](boost::beast::error_code ec) {
+                        if (ec) {
+                            log_error("WebSocket handshake error (" + remoteAddress_ + "): " + ec.message());
+                            return;
+                        }
+                        do_read();
+                    }
+                );
+            }
+        );
+    }
+
+private:
+    // Bills the session to the tenant named by the upgrade request, if any. Returns false
+    // (logged) when the request names one that is not valid.
+    bool identify() {
+        std::string text;
+        auto target = request_.target();
+        auto query = target.find('?');
+        if (query != boost::beast::string_view::npos) {
+            // Other query parameters are the application's business; keep only ours.
+            std::string items(target.substr(query + 1));
+            std::size_t pos = 0;
+            while (pos <= items.size()) {
+                std::size_t end = std::min(items.find('&', pos), items.size());
+                std::string item = items.substr(pos, end - pos);
+                if (item.compare(0, 7, "tenant=") == 0 || item.compare(0, 5, "call=") == 0) {
+                    text += item + " ";
+                }
+                pos = end + 1;
+            }
+        }
+        auto tenant = request_.find("X-Tenant-Id");
+        if (tenant != request_.end()) {
+            text += "tenant=" + std::string(tenant->value()) + " ";
+        }
+        auto call = request_.find("X-Call-Id");
+        if (call != request_.end()) {
+            text += "call=" + std::string(call->value()) + " ";
+        }
+        if (text.empty()) {
+            return true;
+        }
+        stream_identity identity;
+        if (!identity.parse(text)) {
+            log_error("Malformed tenant or call id from " + remoteAddress_);
+            return false;
+        }
+        ncSession_->usage().identify(identity);
+        log_info("Tenant " + identity.tenant + (identity.call.empty() ? "" : ", call " + identity.call) +
+                 ": " + remoteAddress_);
+        return true;
+    }
+
+    void do_read() {
+        auto self(shared_from_this());
+        ws_.async_read(read_buffer_, metered(ncSession_->usage(),
+            [this, self](boost::beast::error_code ec, std::size_t) {
+                if (!ec) {
+                    on_message();
+                } else if (ec == boost::beast::websocket::error::closed ||
+                           ec == boost::asio::error::eof ||
+                           ec == boost::asio::error::connection_reset) {
+                    log_info("Client disconnected: " + remoteAddress_);
+                } else {
+                    log_error("Read error (" + remoteAddress_ + "): " + ec.message());
+                }
+            }
+        ));
+    }
+
+    void on_message() {
+        if (!ws_.got_binary()) {
+            std::string command = boost::beast::buffers_to_string(read_buffer_.cdata());
+            read_buffer_.consume(read_buffer_.size());
+            readDeferred_ = true;
+            send_text(session_control::apply(*ncSession_, command));
+            return;
+        }
+
+        auto data = static_cast<const char*>(read_buffer_.cdata().data());
+        std::size_t len = read_buffer_.size();
+        write_buffer_.clear();
+
+        if (len == 0) {
+            // End of stream: pad and process the trailing partial frame, if any.
+            if (partialBytes_ > 0) {
+                std::memset(partial_.data() + partialBytes_, 0, frameBytes_ - partialBytes_);
+                partialBytes_ = frameBytes_;
+                process_partial();
+            }
+        } else {
+            std::size_t offset = 0;
+            // Complete the frame carried over from the previous message first.
+            if (partialBytes_ > 0) {
+                std::size_t n = std::min(len, frameBytes_ - partialBytes_);
+                std::memcpy(partial_.data() + partialBytes_, data, n);
+                partialBytes_ += n;
+                offset = n;
+                if (partialBytes_ == frameBytes_) {
+                    process_partial();
+                }
+            }
+            // Whole frames are processed straight out of the message buffer.
+            for (; offset + frameBytes_ <= len; offset += frameBytes_) {
+                process_frame(data + offset);
+            }
+            if (offset < len) {
+                partialBytes_ = len - offset;
+                std::memcpy(partial_.data(), data + offset, partialBytes_);
+            }
+        }
+        read_buffer_.consume(len);
+
+        if (write_buffer_.empty()) {
+            do_read();
+        } else if (writing_) {
+            // A text message is being sent; its completion writes the reply.
+            replyDeferred_ = true;
+        } else {
+            do_write();
+        }
+    }
+
+    void process_frame(const char* in) {
+        std::size_t offset = write_buffer_.size();
+        write_buffer_.resize(offset + frameBytes_);
+        ncSession_->process(reinterpret_cast<const int16_t*>(in),
+                            reinterpret_cast<int16_t*>(write_buffer_.data() + offset));
+    }
+
+    void process_partial() {
+        process_frame(partial_.data());
+        partialBytes_ = 0;
+    }
+
+    void do_write() {
+        auto self(shared_from_this());
+        writing_ = true;
+        ws_.binary(true);
+        ws_.async_write(boost::asio::buffer(write_buffer_), metered(ncSession_->usage(),
+            [this, self](boost::beast::error_code ec, std::size_t) {
+                writing_ = false;
+                if (!ec) {
+                    if (!textQueue_.empty()) {
+                        write_text();
+                    }
+                    do_read();
+                } else {
+                    log_error("Write error (" + remoteAddress_ + "): " + ec.message());
+                }
+            }
+        ));
+    }
+
+    void on_drain() override {
+        auto self = weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(ws_.get_executor(), [this, self]() {
+            if (ws_.is_open()) {
+                send_text(drain_notice_text);
+            }
+        });
+    }
+
+    void on_drain_timeout() override {
+        auto self = weak_from_this().lock();
+        if (!self) {
+            return;
+        }
+        boost::asio::post(ws_.get_executor(), [this, self]() {
+            boost::system::error_code ignored;
+            ws_.next_layer().close(ignored);
+        });
+    }
+
+    void send_text(std::string text) {
+        textQueue_.push_back(std::move(text));
+        if (!writing_) {
+            write_text();
+        }
+    }
+
+    void write_text() {
+        auto self(shared_from_this());
+        writing_ = true;
+        ws_.text(true);
+        ws_.async_write(boost::asio::buffer(textQueue_.front()), metered(ncSession_->usage(),
+            [this, self](boost::beast::error_code ec, std::size_t) {
+                writing_ = false;
+                textQueue_.pop_front();
+                if (ec) {
+                    log_error("Text message failed (" + remoteAddress_ + "): " + ec.message());
+                } else if (!textQueue_.empty()) {
+                    write_text();
+                } else if (replyDeferred_) {
+                    replyDeferred_ = false;
+                    do_write();
+                } else if (readDeferred_) {
+                    readDeferred_ = false;
+                    do_read();
+                }
+            }
+        ));
+    }
+
+    boost::beast::websocket::stream<tcp::socket> ws_;
+    boost::asio::steady_timer handshakeTimer_;
+    boost::beast::http::request<boost::beast::http::empty_body> request_;
+    boost::beast::flat_buffer read_buffer_;
+    std::vector<char> write_buffer_;
+    std::vector<char> partial_;
+    std::size_t partialBytes_ = 0;
+    std::size_t frameBytes_ = 0;
+    std::unique_ptr<nc_pipeline> ncSession_;
+    drain_control& drain_;
+    std::deque<std::string> textQueue_;    // control answers and notices, front is being written
+    bool writing_ = false;
+    bool replyDeferred_ = false;    // an audio reply waits for queued text
+    bool readDeferred_ = false;     // the next read waits for a command's answer
+    std::string remoteAddress_;
+    admission_slot slot_;
+    std::atomic<int>& totalConnections_;
+};
@@ -0,0 +1,128 @@
+//
+// Connection churn benchmark: several client threads repeatedly connect to the TCP port, stream
+// a short call of a few frames, read the processed frames back and disconnect, the way short
+// IVR prompts hit the server. Reports completed calls per second and, given the server's pid,
+// its resident set size over time and the drift from the first sample (after warm-up).
+//
+//   apm-churn-bench <port> [seconds] [concurrency] [frames-per-call] [server-pid]
+//
+// A 24-hour soak is `apm-churn-bench 3344 86400 4 10 $(pidof apm-krisp-nc)`; calls rejected by
+// the connection limit are counted separately rather than treated as failures.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench-socket.hpp"
+
+namespace {
+
+constexpr std::size_t frame_bytes = 640;   // 20 ms at 16 kHz, PCM16
+
+std::atomic<bool> running{true};
+std::atomic<uint64_t> completedCalls{0};
+std::atomic<uint64_t> rejectedCalls{0};
+
+void run_client(int port, int framesPerCall) {
+    std::vector<char> out(frame_bytes * static_cast<std::size_t>(framesPerCall), 0x11);
+    std::vector<char> in(out.size());
+    while (running.load(std::memory_order_relaxed)) {
+        int fd = try_connect_tcp(port);
+        if (fd < 0) {
+            ++rejectedCalls;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        bool ok = write_all(fd, out.data(), out.size()) && read_all(fd, in.data(), in.size());
+        close(fd);
+        if (ok) {
+            ++completedCalls;
+        } else {
+            // The server closed the connection without replying: over the connection limit.
+            ++rejectedCalls;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+// Resident set size of a process in kB from /proc, or -1 if unavailable.
+long rss_kb(int pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <port> [seconds] [concurrency] [frames-per-call] [server-pid]\n", argv[0]);
+        return 1;
+    }
+    int port = std::atoi(argv[1]);
+    int seconds = argc > 2 ? std::atoi(argv[2]) : 60;
+    int concurrency = argc > 3 ? std::atoi(argv[3]) : 4;
+    int framesPerCall = argc > 4 ? std::atoi(argv[4]) : 10;
+    int serverPid = argc > 5 ? std::atoi(argv[5]) : 0;
+    if (seconds <= 0 || concurrency <= 0 || framesPerCall <= 0) {
+        std::fprintf(stderr, "seconds, concurrency and frames-per-call must be positive\n");
+        return 1;
+    }
+    // Ten reports per run, at least one second apart and at most one minute apart.
+    int interval = std::min(60, std::max(1, seconds / 10));
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < concurrency; ++i) {
+        clients.emplace_back(run_client, port, framesPerCall);
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    uint64_t lastCalls = 0;
+    long baselineRss = -1;
+    long rss = -1;
+    for (int elapsed = interval; elapsed <= seconds; elapsed += interval) {
+        std::this_thread::sleep_until(start + std::chrono::seconds(elapsed));
+        uint64_t calls = completedCalls.load();
+        double rate = static_cast<double>(calls - lastCalls) / interval;
+        lastCalls = calls;
+        std::printf("t=%6ds  calls/s=%8.1f  total=%llu  rejected=%llu", elapsed, rate,
+                    static_cast<unsigned long long>(calls), static_cast<unsigned long long>(rejectedCalls.load()));
+        if (serverPid > 0 && (rss = rss_kb(serverPid)) >= 0) {
+            // The first interval warms up pools and allocator caches; drift is measured from it.
+            if (baselineRss < 0) {
+                baselineRss = rss;
+            }
+            std::printf("  rss=%ldkB  drift=%+ldkB", rss, rss - baselineRss);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    running = false;
+    for (auto& t : clients) {
+        t.join();
+    }
+    double total = std::chrono::duration<double>(clock::now() - start).count();
+    std::printf("calls=%llu  rejected=%llu  mean calls/s=%.1f",
+                static_cast<unsigned long long>(completedCalls.load()),
+                static_cast<unsigned long long>(rejectedCalls.load()),
+                static_cast<double>(completedCalls.load()) / total);
+    if (baselineRss >= 0 && rss >= 0) {
+        double hours = std::max(total - interval, 1.0) / 3600.0;
+        std::printf("  rss drift=%+ldkB (%+.1fkB/h)", rss - baselineRss, static_cast<double>(rss - baselineRss) / hours);
+    }
+    std::printf("\n");
+    return 0;
+}
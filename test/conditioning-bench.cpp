@@ -0,0 +1,154 @@
+//
+// Input conditioning micro-benchmark and kernel check (src/input_conditioner.hpp).
+//
+//   apm-conditioning-bench [frames] [--max-budget-pct=N]
+//
+// First the vectorized kernels are checked against the portable ones on random frames of every
+// supported frame length, plus odd lengths that exercise the scalar tail; any difference fails.
+// Then each stage is timed over the given number of 20-ms frames at 16 kHz (speech-like tone
+// with noise, a DC offset, clipped bursts and stretches of digital silence), and its cost is
+// reported per frame and as a share of the 20-ms real-time budget. With --max-budget-pct the
+// full conditioning stage must stay below that share, or the exit status is 1.
+//
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/input_conditioner.hpp"
+
+namespace {
+
+constexpr std::size_t frame_samples = 320;   // 20 ms at 16 kHz
+constexpr double frame_budget_ns = 20e6;
+
+bool same(const frame_levels& a, const frame_levels& b) {
+    return a.sum == b.sum && a.sumSquares == b.sumSquares && a.min == b.min && a.max == b.max &&
+           a.clipped == b.clipped;
+}
+
+// Compares the kernels the build uses against the portable ones; returns the number of mismatches.
+int check_kernels() {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> sample(-32768, 32767);
+    std::uniform_int_distribution<int> offset(-2000, 2000);
+    int mismatches = 0;
+    for (std::size_t n : {std::size_t{1}, std::size_t{7}, std::size_t{8}, std::size_t{15}, std::size_t{160},
+                          std::size_t{320}, std::size_t{321}, std::size_t{640}, std::size_t{960}}) {
+        for (int round = 0; round < 200; ++round) {
+            std::vector<int16_t> x(n);
+            for (auto& v : x) {
+                // Every third round is full-scale only, so clipping and saturation are exercised.
+                v = static_cast<int16_t>(round % 3 == 0 ? (sample(rng) < 0 ? -32768 : 32767) : sample(rng));
+            }
+            if (!same(conditioning_kernels::measure(x.data(), n), conditioning_kernels::measure_scalar(x.data(), n))) {
+                std::fprintf(stderr, "measure mismatch at %zu samples\n", n);
+                ++mismatches;
+            }
+            int o = offset(rng);
+            std::vector<int16_t> fast(n), slow(n);
+            conditioning_kernels::subtract_offset(x.data(), fast.data(), n, o);
+            conditioning_kernels::subtract_offset_scalar(x.data(), slow.data(), n, o);
+            if (fast != slow) {
+                std::fprintf(stderr, "subtract_offset mismatch at %zu samples, offset %d\n", n, o);
+                ++mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
+
+std::vector<int16_t> make_signal(std::size_t frames) {
+    std::vector<int16_t> x(frames * frame_samples);
+    std::mt19937 rng(2);
+    std::normal_distribution<double> noise(0, 300);
+    constexpr double pi = 3.14159265358979323846;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        std::size_t frame = i / frame_samples;
+        double v = 0;
+        if (frame % 50 >= 10) {             // 200 ms of digital silence every second
+            v = 400 + 6000 * std::sin(2 * pi * 220 * static_cast<double>(i) / 16000) + noise(rng);
+            if (frame % 50 == 30) {
+                v *= 8;                     // a clipped burst
+            }
+        }
+        x[i] = static_cast<int16_t>(std::clamp(v, -32768.0, 32767.0));
+    }
+    return x;
+}
+
+void report(const char* name, double ns) {
+    std::printf("%-22s %8.1f ns/frame  %8.4f%% of a 20 ms frame\n", name, ns, 100.0 * ns / frame_budget_ns);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t frames = 500000;
+    double maxBudgetPct = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 17, "--max-budget-pct=") == 0) {
+            maxBudgetPct = std::atof(arg.c_str() + 17);
+        } else {
+            frames = static_cast<std::size_t>(std::max(1L, std::atol(arg.c_str())));
+        }
+    }
+
+    int mismatches = check_kernels();
+    std::printf("kernel check: %s\n", mismatches == 0 ? "vectorized and portable kernels agree" : "MISMATCH");
+    if (mismatches != 0) {
+        return 1;
+    }
+
+    // Cycle through one minute of audio so the signal stays in cache, as a session's frame would.
+    std::size_t signalFrames = std::min<std::size_t>(frames, 3000);
+    std::vector<int16_t> signal = make_signal(signalFrames);
+    auto frame_at = [&](std::size_t f) { return signal.data() + (f % signalFrames) * frame_samples; };
+    std::vector<int16_t> out(frame_samples);
+    volatile int64_t sink = 0;
+
+    auto cycle = [&](auto stage) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t f = 0; f < frames; ++f) {
+            stage(frame_at(f));
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+               static_cast<double>(frames);
+    };
+
+    report("measure (portable)", cycle([&](const int16_t* x) {
+        sink = sink + conditioning_kernels::measure_scalar(x, frame_samples).sum;
+    }));
+    report("measure", cycle([&](const int16_t* x) {
+        sink = sink + conditioning_kernels::measure(x, frame_samples).sum;
+    }));
+    report("subtract offset", cycle([&](const int16_t* x) {
+        conditioning_kernels::subtract_offset(x, out.data(), frame_samples, 400);
+        sink = sink + out[frame_samples - 1];
+    }));
+
+    input_conditioner conditioner(frame_samples);
+    double full = cycle([&](const int16_t* x) {
+        sink = sink + conditioner.condition(x, true)[0];
+    });
+    report("condition (mode on)", full);
+
+    auto stats = conditioner.get_stats();
+    std::printf("frames=%llu  silent=%llu  clipped=%llu  max-peak=%.1f dBFS  mean-rms=%.1f dBFS  dc=%.1f\n",
+                static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.silentFrames),
+                static_cast<unsigned long long>(stats.clippedFrames), stats.maxPeakDbfs, stats.meanRmsDbfs,
+                stats.dcOffset);
+
+    if (maxBudgetPct > 0 && 100.0 * full / frame_budget_ns > maxBudgetPct) {
+        std::fprintf(stderr, "FAIL: conditioning takes %.4f%% of the frame budget (max %.4f%%)\n",
+                     100.0 * full / frame_budget_ns, maxBudgetPct);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Front-end test: starts WORKERS worker processes with a --handoff-socket each and a front end in
+# front of them, streams CONNECTIONS concurrent TCP connections through the front end's port, and
+# fails unless every connection was handed to a worker and every worker took a share.
+#
+# SERVER and MODEL select the binary and model, e.g. SERVER=./build-stub/bin/apm-krisp-nc after
+# make stub-test.
+
+set -e
+
+WORKERS=${1:-3}
+CONNECTIONS=${2:-12}
+FRAMES=${3:-500}
+SERVER=${SERVER:-./bin/apm-krisp-nc}
+BENCH=${BENCH:-$(dirname "$SERVER")/apm-transport-bench}
+MODEL=${MODEL:-$PWD/krisp/models/inb.bvc.hs.c6.w.s.23cdb3.kef}
+PORT=3344
+LOG_DIR=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+    kill "${PIDS[@]}" 2>/dev/null || true
+    rm -rf "$LOG_DIR"
+}
+
+trap cleanup EXIT
+
+SOCKETS=""
+for i in $(seq 1 "$WORKERS"); do
+    SOCKET=/tmp/apm-front-end-test-$i.sock
+    SOCKETS="$SOCKETS${SOCKETS:+,}$SOCKET"
+    # Each worker also needs a stream port of its own; clients never use it.
+    "$SERVER" $((PORT + i)) "$MODEL" 100 "$CONNECTIONS" --handoff-socket=$SOCKET > "$LOG_DIR/worker-$i.log" 2>&1 &
+    PIDS+=($!)
+done
+sleep 1
+"$SERVER" $PORT --front-end=$SOCKETS > "$LOG_DIR/front-end.log" 2>&1 &
+FRONT_END_PID=$!
+PIDS+=($FRONT_END_PID)
+sleep 1
+
+"$BENCH" tcp $PORT "$FRAMES" "$CONNECTIONS"
+
+kill -INT $FRONT_END_PID
+wait $FRONT_END_PID || true
+cat "$LOG_DIR/front-end.log"
+
+TOTAL=0
+for i in $(seq 1 "$WORKERS"); do
+    COUNT=$(grep -c "New connection accepted" "$LOG_DIR/worker-$i.log" || true)
+    echo "worker $i: $COUNT connection(s)"
+    if [ "$COUNT" -eq 0 ]; then
+        echo "FAIL: worker $i took no connection"
+        exit 1
+    fi
+    TOTAL=$((TOTAL + COUNT))
+done
+if [ "$TOTAL" -ne "$CONNECTIONS" ]; then
+    echo "FAIL: workers took $TOTAL of $CONNECTIONS connections"
+    exit 1
+fi
+echo "PASS: $CONNECTIONS connections spread over $WORKERS workers"
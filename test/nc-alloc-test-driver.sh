@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Hot-path allocation test: streams FRAMES frames over TCP, the Unix socket and shared memory,
+# one stream at a time, through a server built with allocation counting (make alloc-test), and
+# fails unless every stream reports zero heap allocations after its warm-up frames.
+
+set -e
+
+FRAMES=${1:-1000000}
+LOG_FILE=$(mktemp)
+UNIX_SOCKET=/tmp/apm-alloc-test.sock
+SHM_SOCKET=/tmp/apm-alloc-test-shm.sock
+
+./bin/apm-krisp-nc-alloc-check 3344 "$PWD/krisp/models/inb.bvc.hs.c6.w.s.23cdb3.kef" \
+    --unix-socket=$UNIX_SOCKET --shm-socket=$SHM_SOCKET > "$LOG_FILE" 2>&1 &
+SERVER_PID=$!
+
+cleanup() {
+    kill $SERVER_PID 2>/dev/null || true
+    rm -f "$LOG_FILE"
+}
+
+trap cleanup EXIT
+
+sleep 2
+
+./bin/apm-transport-bench tcp 3344 $FRAMES
+./bin/apm-transport-bench unix $UNIX_SOCKET $FRAMES
+./bin/apm-transport-bench shm $SHM_SOCKET $FRAMES
+
+# Graceful shutdown flushes the per-session reports.
+kill -INT $SERVER_PID
+wait $SERVER_PID || true
+
+grep "Steady-state heap allocations" "$LOG_FILE"
+if [ "$(grep -c "Steady-state heap allocations" "$LOG_FILE")" -ne 3 ]; then
+    echo "FAIL: expected a report from each of the three streams"
+    exit 1
+fi
+if grep "Steady-state heap allocations" "$LOG_FILE" | grep -vq ": 0 over"; then
+    echo "FAIL: heap allocations on the per-frame path"
+    exit 1
+fi
+echo "PASS: no heap allocations over $FRAMES frames per transport"
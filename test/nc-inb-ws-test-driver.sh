@@ -0,0 +1,38 @@
+#!/bin/bash
+
+set -e
+
+INPUT_FILE=${1:-test/input/input-slin16.wav}
+OUTPUT_FILE=${2:-$PWD/test/output/output-ws.wav}
+FRAMES_PER_MESSAGE=${3:-5}
+
+check_npm_package() {
+    if node -e "require.resolve('$1')" 2>/dev/null; then
+        return 0
+    else
+        return 1
+    fi
+}
+
+# Check if wavefile and ws are installed, if not install them
+for package in wavefile ws; do
+    if ! check_npm_package "$package"; then
+        echo "$package package not found. Installing..."
+        npm install $package --no-save
+    fi
+done
+
+./bin/apm-krisp-nc 3344 "$PWD/krisp/models/inb.bvc.hs.c6.w.s.23cdb3.kef" --ws-port=3346 &
+SERVER_PID=$!
+
+cleanup() {
+    echo "Stopping server..."
+    kill $SERVER_PID 2>/dev/null || true
+    sleep 2
+}
+
+trap cleanup EXIT
+
+sleep 2
+
+node test/test-ws-client.js $INPUT_FILE $OUTPUT_FILE 3346 localhost $FRAMES_PER_MESSAGE
@@ -0,0 +1,353 @@
+//
+// Golden-output regression and throughput test for the processing pipeline.
+//
+//   apm-pipeline-test <model_path> <input.wav> <golden.wav> [--server=PATH] [--repeat=N]
+//                     [--min-fps=N] [--max-p99-us=N] [--max-tcp-p99-us=N] [--update-golden]
+//
+// The input (16 kHz mono PCM16) is run through nc_pipeline in-process, one fresh pipeline per
+// pass, exactly as a session feeds it: 20-ms frames with the trailing partial frame zero-padded.
+// The output must be identical in every pass and byte-exact against the golden WAV. Against the
+// passthrough stub SDK (APM_STUB_SDK) the golden output is the padded input itself.
+//
+// With --server, the server binary is started on a free loopback port and the input is streamed
+// over TCP one frame at a time; the returned audio must match the in-process output byte for byte.
+//
+// Frames per second and per-frame latency (in-process process() time, TCP round trip) are
+// reported; the --min-fps / --max-*-us thresholds turn a slowdown into a failure (0 disables).
+// Exit status: 0 pass, 1 failure, 77 skipped because no golden output is recorded yet
+// (--update-golden writes it from the in-process output).
+//
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <krisp-audio-sdk.hpp>
+
+#include "../src/nc_pipeline.hpp"
+#include "bench-socket.hpp"
+
+namespace {
+
+constexpr std::size_t frame_samples = 320;   // 20 ms at 16 kHz
+constexpr int skip_status = 77;
+
+struct options {
+    std::string modelPath;
+    std::string inputPath;
+    std::string goldenPath;
+    std::string serverPath;
+    int repeat = 10;
+    double minFps = 0;
+    double maxP99Us = 0;
+    double maxTcpP99Us = 0;
+    bool updateGolden = false;
+};
+
+struct latency {
+    double fps = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+bool parse_option(const std::string& arg, const char* name, std::string& value) {
+    std::string prefix = std::string("--") + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+// Returns the samples of a 16 kHz mono PCM16 WAV file, or an empty vector.
+std::vector<int16_t> read_wav(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto u16 = [&](std::size_t at) { return static_cast<uint32_t>(static_cast<uint8_t>(bytes[at]) | static_cast<uint8_t>(bytes[at + 1]) << 8); };
+    auto u32 = [&](std::size_t at) { return u16(at) | u16(at + 2) << 16; };
+    if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(bytes.data() + 8, "WAVE", 4) != 0)
+        return {};
+
+    bool formatOk = false;
+    for (std::size_t at = 12; at + 8 <= bytes.size();) {
+        uint32_t size = u32(at + 4);
+        if (std::memcmp(bytes.data() + at, "fmt ", 4) == 0 && size >= 16) {
+            formatOk = u16(at + 8) == 1 && u16(at + 10) == 1 && u32(at + 12) == 16000 && u16(at + 22) == 16;
+        } else if (std::memcmp(bytes.data() + at, "data", 4) == 0 && formatOk) {
+            std::size_t count = std::min<std::size_t>(size, bytes.size() - at - 8) / sizeof(int16_t);
+            std::vector<int16_t> samples(count);
+            std::memcpy(samples.data(), bytes.data() + at + 8, count * sizeof(int16_t));
+            return samples;
+        }
+        at += 8 + size + (size & 1);
+    }
+    return {};
+}
+
+#ifndef APM_STUB_SDK
+bool write_wav(const std::string& path, const std::vector<int16_t>& samples) {
+    std::ofstream file(path, std::ios::binary);
+    auto put = [&](uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i)
+            file.put(static_cast<char>((value >> (8 * i)) & 0xff));
+    };
+    auto data = static_cast<uint32_t>(samples.size() * sizeof(int16_t));
+    file.write("RIFF", 4);
+    put(36 + data, 4);
+    file.write("WAVEfmt ", 8);
+    put(16, 4);
+    put(1, 2);
+    put(1, 2);
+    put(16000, 4);
+    put(32000, 4);
+    put(2, 2);
+    put(16, 2);
+    file.write("data", 4);
+    put(data, 4);
+    file.write(reinterpret_cast<const char*>(samples.data()), static_cast<std::streamsize>(data));
+    return static_cast<bool>(file);
+}
+#endif
+
+latency summarize(std::vector<double>& samples, double seconds) {
+    latency l;
+    if (samples.empty())
+        return l;
+    std::sort(samples.begin(), samples.end());
+    l.fps = static_cast<double>(samples.size()) / seconds;
+    l.p50 = samples[samples.size() / 2];
+    l.p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    l.max = samples.back();
+    return l;
+}
+
+void print_latency(const char* label, const latency& l) {
+    std::printf("%-10s %8.0f frames/s  p50=%.1fus  p99=%.1fus  max=%.1fus\n", label, l.fps, l.p50, l.p99, l.max);
+}
+
+// Index of the first differing sample, or -1.
+long first_difference(const std::vector<int16_t>& a, const std::vector<int16_t>& b) {
+    if (a.size() != b.size())
+        return static_cast<long>(std::min(a.size(), b.size()));
+    auto mismatch = std::mismatch(a.begin(), a.end(), b.begin());
+    return mismatch.first == a.end() ? -1 : static_cast<long>(mismatch.first - a.begin());
+}
+
+// One pass through a fresh pipeline; per-frame process() times go to samples.
+std::vector<int16_t> run_in_process(const options& opt, const std::vector<int16_t>& input, std::vector<double>& samples) {
+    nc_pipeline pipeline(opt.modelPath, nc_pipeline::SamplingRate::Sr16000Hz, 100.0f);
+    std::vector<int16_t> output(input.size());
+    for (std::size_t offset = 0; offset < input.size(); offset += frame_samples) {
+        auto start = std::chrono::steady_clock::now();
+        pipeline.process(input.data() + offset, output.data() + offset);
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    return output;
+}
+
+int free_port() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+        fail("free port");
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// Starts the server with its output discarded and waits until it accepts connections.
+pid_t start_server(const options& opt, int port, int& fd) {
+    pid_t pid = fork();
+    if (pid < 0)
+        fail("fork");
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        std::string portArg = std::to_string(port);
+        execl(opt.serverPath.c_str(), opt.serverPath.c_str(), portArg.c_str(), opt.modelPath.c_str(), "100", "2", "5",
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        fd = try_connect_tcp(port);
+        if (fd >= 0)
+            return pid;
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            std::fprintf(stderr, "server exited during startup (status %d)\n", status);
+            std::exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    kill(pid, SIGKILL);
+    std::fprintf(stderr, "server did not start listening on port %d\n", port);
+    std::exit(1);
+}
+
+// Streams the input one frame at a time and returns what the server sent back.
+std::vector<int16_t> run_tcp(const options& opt, const std::vector<int16_t>& input, std::vector<double>& samples, double& seconds) {
+    int port = free_port();
+    int fd = -1;
+    pid_t pid = start_server(opt, port, fd);
+
+    std::vector<int16_t> output(input.size());
+    const std::size_t frameBytes = frame_samples * sizeof(int16_t);
+    auto begin = std::chrono::steady_clock::now();
+    for (std::size_t offset = 0; offset < input.size(); offset += frame_samples) {
+        auto start = std::chrono::steady_clock::now();
+        write_exact(fd, reinterpret_cast<const char*>(input.data() + offset), frameBytes);
+        read_exact(fd, reinterpret_cast<char*>(output.data() + offset), frameBytes);
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    close(fd);
+
+    kill(pid, SIGINT);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        std::fprintf(stderr, "warning: server exit status %d\n", status);
+    return output;
+}
+
+bool check_limit(const char* what, double value, double limit, bool atLeast) {
+    if (limit <= 0)
+        return true;
+    bool ok = atLeast ? value >= limit : value <= limit;
+    if (!ok)
+        std::printf("FAIL: %s %.1f, limit %.1f\n", what, value, limit);
+    return ok;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    options opt;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i], value;
+        if (parse_option(arg, "server", value)) {
+            opt.serverPath = value;
+        } else if (parse_option(arg, "repeat", value)) {
+            opt.repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (parse_option(arg, "min-fps", value)) {
+            opt.minFps = std::atof(value.c_str());
+        } else if (parse_option(arg, "max-p99-us", value)) {
+            opt.maxP99Us = std::atof(value.c_str());
+        } else if (parse_option(arg, "max-tcp-p99-us", value)) {
+            opt.maxTcpP99Us = std::atof(value.c_str());
+        } else if (arg == "--update-golden") {
+            opt.updateGolden = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 3) {
+        std::fprintf(stderr, "usage: %s <model_path> <input.wav> <golden.wav> [--server=PATH] [--repeat=N]\n"
+                             "       [--min-fps=N] [--max-p99-us=N] [--max-tcp-p99-us=N] [--update-golden]\n", argv[0]);
+        return 1;
+    }
+    opt.modelPath = args[0];
+    opt.inputPath = args[1];
+    opt.goldenPath = args[2];
+
+    std::vector<int16_t> input = read_wav(opt.inputPath);
+    if (input.empty()) {
+        std::fprintf(stderr, "%s: not a 16 kHz mono PCM16 WAV file\n", opt.inputPath.c_str());
+        return 1;
+    }
+    // Sessions zero-pad the trailing partial frame.
+    input.resize((input.size() + frame_samples - 1) / frame_samples * frame_samples, 0);
+    std::printf("input: %zu frames\n", input.size() / frame_samples);
+
+    Krisp::AudioSdk::globalInit(L"");
+    bool ok = true;
+
+    std::vector<double> samples;
+    std::vector<int16_t> output;
+    auto begin = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < opt.repeat; ++pass) {
+        std::vector<int16_t> result = run_in_process(opt, input, samples);
+        if (pass == 0) {
+            output = std::move(result);
+        } else if (first_difference(output, result) >= 0) {
+            std::printf("FAIL: pass %d differs from pass 0 at sample %ld\n", pass, first_difference(output, result));
+            ok = false;
+        }
+    }
+    latency inProcess = summarize(samples, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    print_latency("in-process", inProcess);
+    ok &= check_limit("in-process frames/s", inProcess.fps, opt.minFps, true);
+    ok &= check_limit("in-process p99 us", inProcess.p99, opt.maxP99Us, false);
+
+    bool goldenMissing = false;
+#ifdef APM_STUB_SDK
+    const std::vector<int16_t>& golden = input;
+    std::printf("golden: stub SDK, expecting the input unchanged\n");
+#else
+    if (opt.updateGolden) {
+        if (!write_wav(opt.goldenPath, output)) {
+            std::fprintf(stderr, "cannot write %s\n", opt.goldenPath.c_str());
+            return 1;
+        }
+        std::printf("golden: recorded %s\n", opt.goldenPath.c_str());
+    }
+    std::vector<int16_t> golden = read_wav(opt.goldenPath);
+    goldenMissing = golden.empty();
+    if (goldenMissing)
+        std::printf("golden: %s not found; record it with --update-golden\n", opt.goldenPath.c_str());
+#endif
+    if (!goldenMissing) {
+        long diff = first_difference(golden, output);
+        if (diff >= 0) {
+            std::printf("FAIL: in-process output differs from the golden output at sample %ld\n", diff);
+            ok = false;
+        } else {
+            std::printf("golden: in-process output matches\n");
+        }
+    }
+
+    if (!opt.serverPath.empty()) {
+        std::vector<double> tcpSamples;
+        double seconds = 0;
+        std::vector<int16_t> tcpOutput = run_tcp(opt, input, tcpSamples, seconds);
+        latency tcp = summarize(tcpSamples, seconds);
+        print_latency("tcp", tcp);
+        ok &= check_limit("tcp p99 us", tcp.p99, opt.maxTcpP99Us, false);
+        long diff = first_difference(output, tcpOutput);
+        if (diff >= 0) {
+            std::printf("FAIL: TCP output differs from the in-process output at sample %ld\n", diff);
+            ok = false;
+        } else {
+            std::printf("tcp: output matches in-process output\n");
+        }
+    }
+
+    Krisp::AudioSdk::globalDestroy();
+    if (!ok) {
+        std::printf("FAILED\n");
+        return 1;
+    }
+    if (goldenMissing) {
+        std::printf("SKIPPED (no golden output)\n");
+        return skip_status;
+    }
+    std::printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,549 @@
+//
+// Replay-driven soak test: plays a production traffic profile against the TCP port in a loop for
+// hours and watches the server for slow leaks and latency creep.
+//
+//   apm-soak-replay <port> <profile> [seconds] [--server-pid=N] [--admin-port=N] [--input=WAV]
+//                   [--interval=S] [--csv=FILE] [--tolerance-pct=N] [--seed=N]
+//
+// The profile (see test/profiles/) describes when calls arrive, how long they last and how each
+// kind of client paces its audio. Every call runs on its own thread: it connects, streams frames
+// at the client's pacing, reads the processed frames back and records the per-frame latency
+// (write of a frame group until the last byte of its reply).
+//
+// Every interval one line is printed (and appended to the CSV): calls started / completed /
+// rejected, open calls, per-frame latency percentiles and, given the server's pid, its RSS and
+// open file descriptors. With the admin port, the server's own active stream count is compared
+// with the calls this client has open; the difference ("drift") should stay at zero, and a
+// growing one means the server keeps sessions alive after their connection is gone.
+//
+// At the end a least-squares trend is fitted to RSS, fd count, p99 latency and drift over all
+// intervals after the first (warm-up). Any of them rising by more than --tolerance-pct of its
+// starting value (and by a minimum absolute amount) over the run is reported as an upward trend,
+// and the exit status is 2.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+
+#include "bench-socket.hpp"
+
+namespace {
+
+constexpr std::size_t frame_bytes = 640;   // 20 ms at 16 kHz, PCM16
+constexpr std::chrono::milliseconds frame_duration{20};
+
+using clock_type = std::chrono::steady_clock;
+
+//
+// Traffic profile. Lines (# starts a comment):
+//   arrival_rate R              mean new calls per second, Poisson arrivals
+//   arrival_burst PERIOD N      every PERIOD seconds, N extra calls arrive at once
+//   duration fixed S | uniform A B | exponential MEAN | lognormal MEDIAN SIGMA   (seconds)
+//   client WEIGHT realtime|asap FRAMES_PER_WRITE JITTER_MS
+//   max_calls N                 arrivals beyond N open calls are shed (not sent)
+//   call START DURATION [CLIENT]   recorded call: replayed at START seconds into each loop
+//   loop SECONDS                length of one replay loop of the recorded calls
+// With call lines the recorded calls are replayed in a loop; otherwise calls are generated from
+// the arrival and duration distributions.
+//
+struct client_profile {
+    double weight = 1;
+    bool realtime = true;       // paced at 20 ms per frame; asap writes as fast as replies come
+    int framesPerWrite = 1;     // frames sent per write (burstiness)
+    int jitterMs = 0;           // each write is delayed by up to this much, without drifting
+};
+
+struct recorded_call {
+    double start;
+    double duration;
+    int client;
+};
+
+struct traffic_profile {
+    double arrivalRate = 1;
+    double burstPeriod = 0;
+    int burstCalls = 0;
+    std::string durationKind = "fixed";
+    double durationA = 30;
+    double durationB = 0;
+    std::vector<client_profile> clients;
+    int maxCalls = 1000;
+    std::vector<recorded_call> calls;
+    double loop = 0;
+};
+
+bool load_profile(const std::string& path, traffic_profile& p) {
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "cannot open profile %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string key;
+        if (!(in >> key))
+            continue;
+        bool ok = true;
+        if (key == "arrival_rate") {
+            ok = static_cast<bool>(in >> p.arrivalRate);
+        } else if (key == "arrival_burst") {
+            ok = static_cast<bool>(in >> p.burstPeriod >> p.burstCalls);
+        } else if (key == "duration") {
+            ok = static_cast<bool>(in >> p.durationKind >> p.durationA);
+            if (ok && (p.durationKind == "uniform" || p.durationKind == "lognormal"))
+                ok = static_cast<bool>(in >> p.durationB);
+            ok = ok && (p.durationKind == "fixed" || p.durationKind == "uniform" ||
+                        p.durationKind == "exponential" || p.durationKind == "lognormal");
+        } else if (key == "client") {
+            client_profile c;
+            std::string pacing;
+            ok = static_cast<bool>(in >> c.weight >> pacing >> c.framesPerWrite >> c.jitterMs) &&
+                 (pacing == "realtime" || pacing == "asap") && c.framesPerWrite > 0;
+            c.realtime = pacing == "realtime";
+            p.clients.push_back(c);
+        } else if (key == "max_calls") {
+            ok = static_cast<bool>(in >> p.maxCalls);
+        } else if (key == "call") {
+            recorded_call c{0, 0, 0};
+            ok = static_cast<bool>(in >> c.start >> c.duration);
+            in >> c.client;
+            p.calls.push_back(c);
+        } else if (key == "loop") {
+            ok = static_cast<bool>(in >> p.loop);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "%s:%d: cannot parse '%s'\n", path.c_str(), number, line.c_str());
+            return false;
+        }
+    }
+    if (p.clients.empty())
+        p.clients.push_back(client_profile{});
+    for (auto& c : p.calls) {
+        if (c.client < 0 || c.client >= static_cast<int>(p.clients.size())) {
+            std::fprintf(stderr, "%s: call refers to client %d, but only %zu are defined\n", path.c_str(), c.client, p.clients.size());
+            return false;
+        }
+    }
+    std::sort(p.calls.begin(), p.calls.end(), [](const recorded_call& a, const recorded_call& b) { return a.start < b.start; });
+    if (!p.calls.empty() && p.loop <= p.calls.back().start)
+        p.loop = p.calls.back().start + 1;
+    return true;
+}
+
+// Audio sent by every call: the samples of a PCM16 WAV file, or a fixed pattern.
+std::vector<char> load_audio(const std::string& path) {
+    std::vector<char> audio;
+    if (!path.empty()) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        for (std::size_t at = 12; at + 8 <= bytes.size();) {
+            uint32_t size;
+            std::memcpy(&size, bytes.data() + at + 4, sizeof(size));
+            if (std::memcmp(bytes.data() + at, "data", 4) == 0) {
+                audio.assign(bytes.begin() + static_cast<std::ptrdiff_t>(at + 8),
+                             bytes.begin() + static_cast<std::ptrdiff_t>(std::min<std::size_t>(at + 8 + size, bytes.size())));
+                break;
+            }
+            at += 8 + size + (size & 1);
+        }
+        if (audio.size() < frame_bytes)
+            std::fprintf(stderr, "%s: no usable audio, sending a test pattern\n", path.c_str());
+    }
+    if (audio.size() < frame_bytes) {
+        audio.resize(frame_bytes * 50);
+        for (std::size_t i = 0; i < audio.size(); ++i)
+            audio[i] = static_cast<char>((i * 37) & 0x7f);
+    }
+    audio.resize(audio.size() / frame_bytes * frame_bytes);
+    return audio;
+}
+
+struct shared_state {
+    std::atomic<bool> stopping{false};
+    std::atomic<int> openCalls{0};
+    std::atomic<uint64_t> started{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> rejected{0};      // refused, or closed before the first reply
+    std::atomic<uint64_t> failed{0};        // closed by the server mid-call
+    std::atomic<uint64_t> shed{0};          // not started: max_calls open
+    std::mutex latencyMutex;
+    std::vector<float> latencyUs;           // per-frame latency samples of the current interval
+};
+
+// Latency samples a call collects before handing them to the interval report; about a second of
+// realtime audio, so long calls show up in the interval their frames were sent in.
+constexpr std::size_t publish_samples = 50;
+
+void publish(shared_state& state, std::vector<float>& samples) {
+    std::lock_guard<std::mutex> lock(state.latencyMutex);
+    state.latencyUs.insert(state.latencyUs.end(), samples.begin(), samples.end());
+    samples.clear();
+}
+
+// One call: connect, stream for the given time at the client's pacing, read everything back.
+void run_call(shared_state& state, int port, const std::vector<char>& audio, client_profile client,
+              double seconds, unsigned seed) {
+    struct open_call {
+        shared_state& s;
+        ~open_call() { --s.openCalls; }
+    } call{state};
+
+    int fd = try_connect_tcp(port);
+    if (fd < 0) {
+        ++state.rejected;
+        return;
+    }
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> jitter(0, std::max(client.jitterMs, 0));
+    auto frames = static_cast<std::size_t>(std::max(1.0, seconds * 1000.0 / frame_duration.count()));
+    std::size_t group = static_cast<std::size_t>(client.framesPerWrite);
+    std::vector<char> request(frame_bytes * group);
+    std::vector<char> reply(frame_bytes * group);
+    std::vector<float> samples;
+    samples.reserve(publish_samples);
+
+    bool replied = false;
+    bool ok = true;
+    std::size_t offset = (seed % (audio.size() / frame_bytes)) * frame_bytes;
+    auto deadline = clock_type::now();
+    for (std::size_t sent = 0; sent < frames && ok && !state.stopping.load(std::memory_order_relaxed); sent += group) {
+        std::size_t n = std::min(group, frames - sent);
+        if (client.realtime) {
+            // Pace on absolute deadlines; jitter delays a write without shifting the ones after it.
+            std::this_thread::sleep_until(deadline + std::chrono::milliseconds(jitter(rng)));
+            deadline += frame_duration * static_cast<int>(n);
+        }
+        // A group goes out in one write, as a gateway sends one packet of several frames.
+        for (std::size_t i = 0; i < n; ++i) {
+            std::memcpy(request.data() + i * frame_bytes, audio.data() + offset, frame_bytes);
+            offset = (offset + frame_bytes) % audio.size();
+        }
+        auto start = clock_type::now();
+        ok = write_all(fd, request.data(), n * frame_bytes) && read_all(fd, reply.data(), n * frame_bytes);
+        if (ok) {
+            replied = true;
+            samples.push_back(std::chrono::duration<float, std::micro>(clock_type::now() - start).count());
+            if (samples.size() >= publish_samples)
+                publish(state, samples);
+        }
+    }
+    close(fd);
+
+    if (ok) {
+        ++state.completed;
+    } else if (!replied) {
+        ++state.rejected;
+    } else {
+        ++state.failed;
+    }
+    publish(state, samples);
+}
+
+// Number of open file descriptors of a process, or -1 if unavailable.
+long fd_count(int pid) {
+    DIR* dir = opendir(("/proc/" + std::to_string(pid) + "/fd").c_str());
+    if (dir == nullptr)
+        return -1;
+    long count = 0;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Resident set size of a process in kB from /proc, or -1 if unavailable.
+long rss_kb(int pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return std::atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+// The server's active stream count from the admin endpoint's /health, or -1.
+long server_active_streams(int adminPort) {
+    int fd = try_connect_tcp(adminPort);
+    if (fd < 0)
+        return -1;
+    const char request[] = "GET /health HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    std::string response;
+    if (write_all(fd, request, sizeof(request) - 1)) {
+        char buffer[1024];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+            response.append(buffer, static_cast<std::size_t>(n));
+    }
+    close(fd);
+    const char key[] = "\"active_streams\":";
+    std::size_t at = response.find(key);
+    return at == std::string::npos ? -1 : std::atol(response.c_str() + at + sizeof(key) - 1);
+}
+
+struct sample {
+    double t;           // seconds since start
+    long rss;
+    long fds;
+    double p99;
+    long drift;
+    bool hasServer;
+    bool hasDrift;
+};
+
+double percentile(std::vector<float>& v, double q) {
+    if (v.empty())
+        return 0;
+    std::size_t i = std::min(v.size() - 1, static_cast<std::size_t>(q * static_cast<double>(v.size())));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(i), v.end());
+    return v[i];
+}
+
+// Fits value = a + b * t over the samples and reports whether the fitted rise across them
+// exceeds tolerance (a fraction of the starting value) and floor (absolute).
+bool check_trend(const char* name, const std::vector<sample>& samples, double (*value)(const sample&),
+                 double tolerance, double floor, const char* unit) {
+    std::size_t n = samples.size();
+    if (n < 3) {
+        std::printf("trend %-6s not enough intervals\n", name);
+        return true;
+    }
+    double st = 0, sv = 0, stt = 0, stv = 0;
+    for (auto& s : samples) {
+        st += s.t;
+        sv += value(s);
+        stt += s.t * s.t;
+        stv += s.t * value(s);
+    }
+    double dn = static_cast<double>(n);
+    double denom = dn * stt - st * st;
+    double slope = denom != 0 ? (dn * stv - st * sv) / denom : 0;
+    double intercept = (sv - slope * st) / dn;
+    double first = intercept + slope * samples.front().t;
+    double rise = slope * (samples.back().t - samples.front().t);
+    double limit = std::max(floor, tolerance * std::fabs(first));
+    bool ok = rise <= limit;
+    std::printf("trend %-6s %+12.1f %s over the run (%+.1f %s/h, start %.1f)%s\n", name, rise, unit,
+                slope * 3600, unit, first, ok ? "" : "  UPWARD TREND");
+    return ok;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    int serverPid = 0, adminPort = 0, interval = 0;
+    double tolerance = 10;
+    unsigned seed = std::random_device{}();
+    std::string inputPath, csvPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            std::string prefix = std::string("--") + name + "=";
+            return arg.compare(0, prefix.size(), prefix) == 0 ? argv[i] + prefix.size() : nullptr;
+        };
+        if (const char* v = value("server-pid")) {
+            serverPid = std::atoi(v);
+        } else if (const char* v = value("admin-port")) {
+            adminPort = std::atoi(v);
+        } else if (const char* v = value("input")) {
+            inputPath = v;
+        } else if (const char* v = value("interval")) {
+            interval = std::atoi(v);
+        } else if (const char* v = value("csv")) {
+            csvPath = v;
+        } else if (const char* v = value("tolerance-pct")) {
+            tolerance = std::atof(v);
+        } else if (const char* v = value("seed")) {
+            seed = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() < 2) {
+        std::fprintf(stderr, "Usage: %s <port> <profile> [seconds] [--server-pid=N] [--admin-port=N] [--input=WAV]\n"
+                             "       [--interval=S] [--csv=FILE] [--tolerance-pct=N] [--seed=N]\n", argv[0]);
+        return 1;
+    }
+    int port = std::atoi(args[0].c_str());
+    traffic_profile profile;
+    if (!load_profile(args[1], profile))
+        return 1;
+    int seconds = args.size() > 2 ? std::atoi(args[2].c_str()) : 3600;
+    if (seconds <= 0) {
+        std::fprintf(stderr, "seconds must be positive\n");
+        return 1;
+    }
+    // Twenty reports per run by default, at least one second and at most five minutes apart.
+    if (interval <= 0)
+        interval = std::min(300, std::max(1, seconds / 20));
+    std::vector<char> audio = load_audio(inputPath);
+    std::printf("seed=%u  profile=%s  %s\n", seed, args[1].c_str(),
+                profile.calls.empty() ? "generated arrivals" : "recorded calls");
+
+    std::FILE* csv = nullptr;
+    if (!csvPath.empty()) {
+        csv = std::fopen(csvPath.c_str(), "w");
+        if (csv == nullptr)
+            fail("open " + csvPath);
+        std::fprintf(csv, "t,started,completed,rejected,failed,shed,open,server_active,drift,rss_kb,fds,p50_us,p95_us,p99_us,max_us\n");
+    }
+
+    shared_state state;
+    std::mt19937 rng(seed);
+    std::vector<double> weights;
+    for (auto& c : profile.clients)
+        weights.push_back(c.weight);
+    std::discrete_distribution<int> pickClient(weights.begin(), weights.end());
+    std::exponential_distribution<double> interArrival(std::max(profile.arrivalRate, 1e-9));
+
+    auto draw_duration = [&]() {
+        double d = profile.durationA;
+        if (profile.durationKind == "uniform") {
+            d = std::uniform_real_distribution<double>(profile.durationA, profile.durationB)(rng);
+        } else if (profile.durationKind == "exponential") {
+            d = std::exponential_distribution<double>(1.0 / profile.durationA)(rng);
+        } else if (profile.durationKind == "lognormal") {
+            d = std::lognormal_distribution<double>(std::log(profile.durationA), profile.durationB)(rng);
+        }
+        return std::max(0.02, d);
+    };
+    auto start_call = [&](int client, double duration) {
+        if (state.openCalls.load() >= profile.maxCalls) {
+            ++state.shed;
+            return;
+        }
+        ++state.openCalls;
+        ++state.started;
+        std::thread(run_call, std::ref(state), port, std::cref(audio), profile.clients[static_cast<std::size_t>(client)],
+                    duration, static_cast<unsigned>(rng())).detach();
+    };
+
+    auto start = clock_type::now();
+    auto end = start + std::chrono::seconds(seconds);
+    auto at = [&](double s) { return start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(s)); };
+    double nextArrival = profile.calls.empty() ? interArrival(rng) : 0;
+    double nextBurst = profile.burstPeriod > 0 ? profile.burstPeriod : 1e300;
+    std::size_t nextRecorded = 0;
+    double loopStart = 0;
+    int nextReport = interval;
+    std::vector<sample> samples;
+
+    while (clock_type::now() < end) {
+        double now = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        if (profile.calls.empty()) {
+            while (nextArrival <= now) {
+                start_call(pickClient(rng), draw_duration());
+                nextArrival += interArrival(rng);
+            }
+            while (nextBurst <= now) {
+                for (int i = 0; i < profile.burstCalls; ++i)
+                    start_call(pickClient(rng), draw_duration());
+                nextBurst += profile.burstPeriod;
+            }
+        } else {
+            while (loopStart + profile.calls[nextRecorded].start <= now) {
+                auto& c = profile.calls[nextRecorded];
+                start_call(c.client, c.duration);
+                if (++nextRecorded == profile.calls.size()) {
+                    nextRecorded = 0;
+                    loopStart += profile.loop;
+                }
+            }
+        }
+
+        if (now >= nextReport) {
+            std::vector<float> latency;
+            {
+                std::lock_guard<std::mutex> lock(state.latencyMutex);
+                latency.swap(state.latencyUs);
+            }
+            double p50 = percentile(latency, 0.50), p95 = percentile(latency, 0.95), p99 = percentile(latency, 0.99);
+            double max = latency.empty() ? 0 : *std::max_element(latency.begin(), latency.end());
+            int open = state.openCalls.load();
+            long active = adminPort > 0 ? server_active_streams(adminPort) : -1;
+            long drift = active >= 0 ? active - open : 0;
+            long rss = serverPid > 0 ? rss_kb(serverPid) : -1;
+            long fds = serverPid > 0 ? fd_count(serverPid) : -1;
+
+            std::printf("t=%6ds  calls=%llu/%llu  rej=%llu  fail=%llu  shed=%llu  open=%d",
+                        nextReport, static_cast<unsigned long long>(state.completed.load()),
+                        static_cast<unsigned long long>(state.started.load()),
+                        static_cast<unsigned long long>(state.rejected.load()),
+                        static_cast<unsigned long long>(state.failed.load()),
+                        static_cast<unsigned long long>(state.shed.load()), open);
+            if (active >= 0)
+                std::printf("  server=%ld  drift=%+ld", active, drift);
+            if (rss >= 0)
+                std::printf("  rss=%ldkB  fds=%ld", rss, fds);
+            std::printf("  p50=%.0fus  p99=%.0fus  max=%.0fus\n", p50, p99, max);
+            std::fflush(stdout);
+            if (csv != nullptr) {
+                std::fprintf(csv, "%d,%llu,%llu,%llu,%llu,%llu,%d,%ld,%ld,%ld,%ld,%.0f,%.0f,%.0f,%.0f\n", nextReport,
+                             static_cast<unsigned long long>(state.started.load()),
+                             static_cast<unsigned long long>(state.completed.load()),
+                             static_cast<unsigned long long>(state.rejected.load()),
+                             static_cast<unsigned long long>(state.failed.load()),
+                             static_cast<unsigned long long>(state.shed.load()), open, active, drift, rss, fds,
+                             p50, p95, p99, max);
+                std::fflush(csv);
+            }
+            samples.push_back(sample{static_cast<double>(nextReport), rss, fds, p99, drift, rss >= 0, active >= 0});
+            nextReport += interval;
+        }
+
+        double wake = std::min({nextArrival, nextBurst, static_cast<double>(nextReport),
+                                profile.calls.empty() ? 1e300 : loopStart + profile.calls[nextRecorded].start});
+        std::this_thread::sleep_until(std::min(at(wake), end));
+    }
+
+    // Let open calls end early, then wait for them.
+    state.stopping = true;
+    while (state.openCalls.load() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (csv != nullptr)
+        std::fclose(csv);
+
+    std::printf("calls=%llu  completed=%llu  rejected=%llu  failed=%llu  shed=%llu\n",
+                static_cast<unsigned long long>(state.started.load()),
+                static_cast<unsigned long long>(state.completed.load()),
+                static_cast<unsigned long long>(state.rejected.load()),
+                static_cast<unsigned long long>(state.failed.load()),
+                static_cast<unsigned long long>(state.shed.load()));
+
+    // The first interval warms up pools and allocator caches; trends are fitted after it.
+    std::vector<sample> steady(samples.begin() + std::min<std::ptrdiff_t>(1, static_cast<std::ptrdiff_t>(samples.size())), samples.end());
+    double t = tolerance / 100.0;
+    bool ok = check_trend("p99", steady, [](const sample& s) { return s.p99; }, t, 1000, "us");
+    if (!steady.empty() && steady.front().hasServer) {
+        ok &= check_trend("rss", steady, [](const sample& s) { return static_cast<double>(s.rss); }, t, 2048, "kB");
+        ok &= check_trend("fds", steady, [](const sample& s) { return static_cast<double>(s.fds); }, t, 4, "fds");
+    }
+    if (!steady.empty() && steady.front().hasDrift)
+        ok &= check_trend("drift", steady, [](const sample& s) { return static_cast<double>(s.drift); }, t, 2, "streams");
+    return ok ? 0 : 2;
+}
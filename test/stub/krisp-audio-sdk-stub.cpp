@@ -0,0 +1,50 @@
+//
+// Passthrough stand-in for the Krisp Audio SDK library, for building and testing the server
+// where the SDK is not available (cmake -D APM_STUB_SDK=ON). It implements the entry points the
+// server uses against the SDK's own headers: sessions copy every frame through unchanged and
+// report empty statistics. Model paths are not read.
+//
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <krisp-audio-sdk.hpp>
+#include <krisp-audio-sdk-nc.hpp>
+
+namespace Krisp::AudioSdk {
+
+void globalInit(const std::wstring&) {
+}
+
+void globalDestroy() {
+}
+
+template <typename FrameDataType>
+class NcSession {
+};
+
+template <typename FrameDataType>
+Nc<FrameDataType>::~Nc() = default;
+
+template <typename FrameDataType>
+std::shared_ptr<Nc<FrameDataType>> Nc<FrameDataType>::create(const NcSessionConfig&) {
+    struct stub_nc : Nc<FrameDataType> {
+    };
+    return std::make_shared<stub_nc>();
+}
+
+template <typename FrameDataType>
+void Nc<FrameDataType>::process(const FrameDataType* inputSamples, size_t numInputSamples,
+                                FrameDataType* outputSamples, size_t numOutputSamples, float, PerFrameStats*) {
+    std::memmove(outputSamples, inputSamples, std::min(numInputSamples, numOutputSamples) * sizeof(FrameDataType));
+}
+
+template <typename FrameDataType>
+void Nc<FrameDataType>::getSessionStats(SessionStats* stats) {
+    std::memset(stats, 0, sizeof(*stats));
+}
+
+template class Nc<int16_t>;
+template class Nc<float>;
+
+}
@@ -0,0 +1,197 @@
+const dgram = require('dgram');
+const fs = require('fs');
+const { WaveFile } = require('wavefile');
+
+// G.711 companding, matching src/g711.hpp.
+function linearToUlaw(sample) {
+    const bias = 0x84, clip = 32635;
+    let sign = 0;
+    if (sample < 0) { sign = 0x80; sample = -sample; }
+    if (sample > clip) sample = clip;
+    sample += bias;
+    let exponent = 7;
+    for (let mask = 0x4000; (sample & mask) === 0 && exponent > 0; mask >>= 1) exponent--;
+    const mantissa = (sample >> (exponent + 3)) & 0x0F;
+    return ~(sign | (exponent << 4) | mantissa) & 0xFF;
+}
+
+function ulawToLinear(u) {
+    const bias = 0x84;
+    u = ~u & 0xFF;
+    let t = ((u & 0x0F) << 3) + bias;
+    t <<= (u & 0x70) >> 4;
+    return (u & 0x80) ? (bias - t) : (t - bias);
+}
+
+function linearToAlaw(sample) {
+    const clip = 32635;
+    let sign = 0x80;
+    if (sample < 0) { sign = 0; sample = -sample; }
+    if (sample > clip) sample = clip;
+    let compressed;
+    if (sample >= 256) {
+        let exponent = 1;
+        for (let v = sample >> 8; v > 1; v >>= 1) exponent++;
+        compressed = (exponent << 4) | ((sample >> (exponent + 3)) & 0x0F);
+    } else {
+        compressed = sample >> 4;
+    }
+    return (compressed ^ (sign ^ 0x55)) & 0xFF;
+}
+
+function alawToLinear(a) {
+    a ^= 0x55;
+    let t = (a & 0x0F) << 4;
+    const segment = (a & 0x70) >> 4;
+    if (segment === 0) t += 8;
+    else if (segment === 1) t += 0x108;
+    else t = (t + 0x108) << (segment - 1);
+    return (a & 0x80) ? t : -t;
+}
+
+const CODECS = {
+    l16:  { payloadType: 96, sampleRate: 16000 },
+    pcmu: { payloadType: 0,  sampleRate: 8000 },
+    pcma: { payloadType: 8,  sampleRate: 8000 },
+};
+
+//
+// Loopback RTP sender: streams a 16 kHz mono WAV file to the server as 20-ms RTP packets
+// (optionally shuffling neighbouring packets to exercise the reorder window), collects the
+// processed packets and writes them to an output WAV at the codec's sampling rate.
+//
+class RtpClient {
+    constructor(host = 'localhost', port = 3345, codec = 'l16', reorderRate = 0) {
+        this.host = host;
+        this.port = port;
+        this.codec = CODECS[codec];
+        this.codecName = codec;
+        this.reorderRate = reorderRate;
+        this.socket = dgram.createSocket('udp4');
+        this.ssrc = Math.floor(Math.random() * 0xFFFFFFFF) >>> 0;
+    }
+
+    encodePacket(seq, timestamp, samples) {
+        const bytesPerSample = this.codecName === 'l16' ? 2 : 1;
+        const packet = Buffer.alloc(12 + samples.length * bytesPerSample);
+        packet[0] = 0x80;
+        packet[1] = this.codec.payloadType | (seq === 0 ? 0x80 : 0);
+        packet.writeUInt16BE(seq & 0xFFFF, 2);
+        packet.writeUInt32BE(timestamp >>> 0, 4);
+        packet.writeUInt32BE(this.ssrc, 8);
+        samples.forEach((sample, i) => {
+            if (this.codecName === 'l16') packet.writeInt16BE(sample, 12 + i * 2);
+            else if (this.codecName === 'pcmu') packet[12 + i] = linearToUlaw(sample);
+            else packet[12 + i] = linearToAlaw(sample);
+        });
+        return packet;
+    }
+
+    decodePayload(payload) {
+        const samples = [];
+        if (this.codecName === 'l16') {
+            for (let i = 0; i + 1 < payload.length; i += 2) samples.push(payload.readInt16BE(i));
+        } else {
+            const decode = this.codecName === 'pcmu' ? ulawToLinear : alawToLinear;
+            for (const b of payload) samples.push(decode(b));
+        }
+        return samples;
+    }
+
+    async processFile(inputFile, outputFile) {
+        const wav = new WaveFile(fs.readFileSync(inputFile));
+        if (wav.fmt.numChannels !== 1 || wav.fmt.bitsPerSample !== 16 || wav.fmt.sampleRate !== 16000) {
+            throw new Error('Only 16 kHz mono 16-bit PCM input is supported');
+        }
+        let input = Array.from(wav.getSamples(false, Int16Array));
+        if (this.codec.sampleRate === 8000) {
+            // Crude 2:1 decimation with a two-tap average; good enough for a transport test.
+            const decimated = [];
+            for (let i = 0; i + 1 < input.length; i += 2) decimated.push((input[i] + input[i + 1]) >> 1);
+            input = decimated;
+        }
+
+        const samplesPerPacket = this.codec.sampleRate * 20 / 1000;
+        const packets = [];
+        for (let seq = 0; seq * samplesPerPacket < input.length; seq++) {
+            const frame = input.slice(seq * samplesPerPacket, (seq + 1) * samplesPerPacket);
+            while (frame.length < samplesPerPacket) frame.push(0);
+            packets.push(this.encodePacket(seq, seq * samplesPerPacket, frame));
+        }
+        // Swap neighbouring packets to simulate reordering on the network.
+        let reordered = 0;
+        for (let i = 0; i + 1 < packets.length; i++) {
+            if (Math.random() < this.reorderRate) {
+                [packets[i], packets[i + 1]] = [packets[i + 1], packets[i]];
+                reordered++;
+                i++;
+            }
+        }
+
+        const received = new Map();
+        this.socket.on('message', (msg) => {
+            const timestamp = msg.readUInt32BE(4);
+            received.set(timestamp, this.decodePayload(msg.subarray(12)));
+        });
+
+        const startTime = process.hrtime.bigint();
+        for (const packet of packets) {
+            this.socket.send(packet, this.port, this.host);
+            await new Promise(r => setTimeout(r, 20));
+        }
+        // Give the server time to return the last frames.
+        await new Promise(r => setTimeout(r, 500));
+        this.socket.close();
+
+        const timestamps = Array.from(received.keys()).sort((a, b) => a - b);
+        const output = new Int16Array(timestamps.length * samplesPerPacket);
+        timestamps.forEach((ts, i) => output.set(received.get(ts), i * samplesPerPacket));
+
+        const outWav = new WaveFile();
+        outWav.fromScratch(1, this.codec.sampleRate, '16', output);
+        const outputDir = outputFile.substring(0, outputFile.lastIndexOf('/'));
+        if (outputDir && !fs.existsSync(outputDir)) {
+            fs.mkdirSync(outputDir, { recursive: true });
+        }
+        fs.writeFileSync(outputFile, outWav.toBuffer());
+
+        const totalTimeMs = Number(process.hrtime.bigint() - startTime) / 1_000_000;
+        console.log(`\nRTP processing complete (${this.codecName}):`);
+        console.log(`Packets sent: ${packets.length} (${reordered} reordered pairs)`);
+        console.log(`Packets received: ${received.size}`);
+        console.log(`Total time: ${totalTimeMs.toFixed(2)}ms`);
+        console.log(`Output file generated: ${outputFile}`);
+        if (received.size < packets.length) {
+            throw new Error(`Missing ${packets.length - received.size} processed packet(s)`);
+        }
+    }
+}
+
+// Run as command-line tool if called directly
+if (require.main === module) {
+    if (process.argv.length < 4) {
+        console.error('Usage: node test-rtp-client.js <input-wav> <output-wav> [port] [host] [l16|pcmu|pcma] [reorder-rate]');
+        process.exit(1);
+    }
+
+    const inputFile = process.argv[2];
+    const outputFile = process.argv[3];
+    const port = Number(process.argv[4] ?? '3345');
+    const host = process.argv[5] ?? 'localhost';
+    const codec = process.argv[6] ?? 'l16';
+    const reorderRate = Number(process.argv[7] ?? '0.05');
+
+    if (!CODECS[codec]) {
+        console.error(`Unknown codec: ${codec}`);
+        process.exit(1);
+    }
+
+    const client = new RtpClient(host, port, codec, reorderRate);
+    client.processFile(inputFile, outputFile)
+        .catch(err => {
+            console.error('Error:', err.message);
+            process.exit(1);
+        });
+}
+
+module.exports = RtpClient;
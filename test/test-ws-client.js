@@ -0,0 +1,104 @@
+const fs = require('fs');
+const WebSocket = require('ws');
+const { WaveFile } = require('wavefile');
+
+//
+// WebSocket test client: streams a 16 kHz mono WAV file to the server's WebSocket port in
+// binary messages of several frames each, collects the processed replies and writes them to
+// an output WAV. An empty binary message tells the server to flush the trailing partial frame.
+//
+class WsAudioClient {
+    constructor(host = 'localhost', port = 3346, framesPerMessage = 5) {
+        this.url = `ws://${host}:${port}/`;
+        this.framesPerMessage = framesPerMessage;
+    }
+
+    async processFile(inputFile, outputFile) {
+        const wav = new WaveFile(fs.readFileSync(inputFile));
+        if (wav.fmt.numChannels !== 1 || wav.fmt.audioFormat !== 1 || wav.fmt.bitsPerSample !== 16) {
+            throw new Error('Only mono 16-bit PCM audio is supported');
+        }
+        const sampleRate = wav.fmt.sampleRate;
+        const bytesPerFrame = Math.floor(sampleRate * 0.02) * 2;
+        const bytesPerMessage = bytesPerFrame * this.framesPerMessage;
+        const audioData = Buffer.from(wav.data.samples);
+        const expectedBytes = Math.ceil(audioData.length / bytesPerFrame) * bytesPerFrame;
+
+        const ws = new WebSocket(this.url);
+        ws.binaryType = 'nodebuffer';
+        const chunks = [];
+        let received = 0;
+
+        await new Promise((resolve, reject) => {
+            ws.on('error', reject);
+            ws.on('open', async () => {
+                this.startTime = process.hrtime.bigint();
+                for (let offset = 0; offset < audioData.length; offset += bytesPerMessage) {
+                    ws.send(audioData.subarray(offset, offset + bytesPerMessage), { binary: true });
+                    // Send in real time: one message per framesPerMessage * 20 ms.
+                    await new Promise(r => setTimeout(r, 20 * this.framesPerMessage));
+                }
+                ws.send(Buffer.alloc(0), { binary: true });
+            });
+            ws.on('message', (data, isBinary) => {
+                if (!isBinary) {
+                    // Control message, e.g. {"event":"drain"} when the server starts shutting down.
+                    console.log(`Control message: ${data}`);
+                    return;
+                }
+                chunks.push(data);
+                received += data.length;
+                if (received >= expectedBytes) {
+                    ws.close(1000);
+                }
+            });
+            ws.on('close', resolve);
+        });
+
+        const processedData = Buffer.concat(chunks);
+        const samples = new Int16Array(processedData.length / 2);
+        for (let i = 0; i < processedData.length; i += 2) {
+            samples[i / 2] = processedData.readInt16LE(i);
+        }
+        const outputDir = outputFile.substring(0, outputFile.lastIndexOf('/'));
+        if (outputDir && !fs.existsSync(outputDir)) {
+            fs.mkdirSync(outputDir, { recursive: true });
+        }
+        const outWav = new WaveFile();
+        outWav.fromScratch(1, sampleRate, '16', samples);
+        fs.writeFileSync(outputFile, outWav.toBuffer());
+
+        const totalTimeMs = Number(process.hrtime.bigint() - this.startTime) / 1_000_000;
+        console.log(`\nProcessing complete:`);
+        console.log(`Total time: ${totalTimeMs.toFixed(2)}ms`);
+        console.log(`Total bytes sent: ${audioData.length}`);
+        console.log(`Total bytes received: ${received}`);
+        console.log(`Output file generated: ${outputFile}`);
+        if (received !== expectedBytes) {
+            throw new Error(`Expected ${expectedBytes} bytes back, got ${received}`);
+        }
+    }
+}
+
+// Run as command-line tool if called directly
+if (require.main === module) {
+    if (process.argv.length < 4) {
+        console.error('Usage: node test-ws-client.js <input-wav> <output-wav> [port] [host] [frames-per-message]');
+        process.exit(1);
+    }
+
+    const inputFile = process.argv[2];
+    const outputFile = process.argv[3];
+    const port = process.argv[4] ?? '3346';
+    const host = process.argv[5] ?? 'localhost';
+    const framesPerMessage = Number(process.argv[6] ?? '5');
+
+    const client = new WsAudioClient(host, port, framesPerMessage);
+    client.processFile(inputFile, outputFile)
+        .catch(err => {
+            console.error('Error:', err.message);
+            process.exit(1);
+        });
+}
+
+module.exports = WsAudioClient;
@@ -0,0 +1,259 @@
+//
+// Transport round-trip benchmark: sends 20-ms frames one at a time to a running server and
+// waits for each processed frame before sending the next, so the measured time is the per-frame
+// round trip of the transport plus one process() call.
+//
+//   apm-transport-bench tcp  <port>      [frames] [connections] [server-pid] [--tenant=ID]
+//   apm-transport-bench unix <path>      [frames] [connections] [server-pid] [--tenant=ID]
+//   apm-transport-bench shm  <path>      [frames] [connections] [server-pid] [--tenant=ID]
+//
+// The shm mode creates the shared-memory region and eventfds itself and hands them to the
+// server's --shm-socket listener, exactly as a co-located client would.
+//
+// With several connections, each runs its own ping-pong loop on a thread and frames are counted
+// per connection. Given the server's pid, the server's CPU time (user + system, from /proc) per
+// processed frame is reported too; that is the figure to compare between I/O backends, e.g. the
+// epoll-based main port against --io-uring-port under the same stub processor.
+//
+// With --tenant, every connection names that tenant in its handshake (the APM/1 line on stream
+// transports, the attach payload on shm), so the server's GET /usage shows what the run cost.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/shm_ring.hpp"
+#include "bench-socket.hpp"
+
+namespace {
+
+constexpr uint32_t frame_bytes = 640;   // 20 ms at 16 kHz, PCM16
+constexpr uint32_t ring_capacity = 64;
+constexpr int spin_iterations = 2000;
+
+// Stream transports (TCP, Unix socket): one write and one full-frame read per frame.
+template <typename Clock>
+void run_stream(int fd, int frames, std::vector<double>& samples) {
+    std::vector<char> out(frame_bytes), in(frame_bytes);
+    for (int i = 0; i < frames; ++i) {
+        std::memset(out.data(), i & 0x7F, out.size());
+        auto start = Clock::now();
+        write_exact(fd, out.data(), out.size());
+        read_exact(fd, in.data(), in.size());
+        samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    close(fd);
+}
+
+// "tenant=ID call=bench-N" for the handshake, or empty without --tenant.
+std::string identity_text(const std::string& tenant, std::size_t connection) {
+    return tenant.empty() ? std::string() : "tenant=" + tenant + " call=bench-" + std::to_string(connection);
+}
+
+struct shm_client {
+    int control = -1;
+    int toServer = -1;     // eventfd the server waits on
+    int fromServer = -1;   // eventfd the server signals
+    void* region = nullptr;
+    std::size_t size = 0;
+};
+
+shm_client attach_shm(const std::string& path, const std::string& identity) {
+    shm_client c;
+    c.size = shm_region_size(frame_bytes, ring_capacity);
+    int memfd = memfd_create("apm-transport-bench", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0 || ftruncate(memfd, static_cast<off_t>(c.size)) != 0)
+        fail("memfd");
+    // The server only maps regions that cannot shrink under it.
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0)
+        fail("seal");
+    c.region = mmap(nullptr, c.size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (c.region == MAP_FAILED)
+        fail("mmap");
+    shm_ring::init(c.region, frame_bytes, ring_capacity);
+    c.toServer = eventfd(0, EFD_CLOEXEC);
+    c.fromServer = eventfd(0, EFD_CLOEXEC);
+    if (c.toServer < 0 || c.fromServer < 0)
+        fail("eventfd");
+
+    c.control = connect_unix(path);
+    char byte = 0;
+    std::string payload = identity.empty() ? std::string(1, '\0') : identity;
+    iovec iov{&payload[0], payload.size()};
+    int fds[3] = {memfd, c.toServer, c.fromServer};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(c.control, &msg, 0) != static_cast<ssize_t>(payload.size()))
+        fail("sendmsg");
+    close(memfd);
+    read_exact(c.control, &byte, 1);   // server ack: region validated and mapped
+    if (byte == 'B') {
+        std::fprintf(stderr, "shm: server busy\n");
+        std::exit(1);
+    }
+    return c;
+}
+
+template <typename Clock>
+void run_shm(const std::string& path, const std::string& identity, int frames, std::vector<double>& samples) {
+    shm_client c = attach_shm(path, identity);
+    shm_ring ring(c.region, frame_bytes, ring_capacity);
+    auto& header = ring.header();
+    std::vector<char> in(frame_bytes);
+
+    for (int i = 0; i < frames; ++i) {
+        auto start = Clock::now();
+        std::memset(ring.in_back(), i & 0x7F, frame_bytes);
+        ring.in_push();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (header.serverWaiting.load(std::memory_order_relaxed) != 0) {
+            uint64_t one = 1;
+            if (write(c.toServer, &one, sizeof(one)) != sizeof(one))
+                fail("eventfd write");
+        }
+
+        // Spin briefly, then announce we are sleeping and block on the eventfd.
+        for (int spin = 0; ring.out_available() == 0; ++spin) {
+            if (spin < spin_iterations)
+                continue;
+            header.clientWaiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring.out_available() == 0) {
+                uint64_t count = 0;
+                if (read(c.fromServer, &count, sizeof(count)) != sizeof(count))
+                    fail("eventfd read");
+            }
+            header.clientWaiting.store(0, std::memory_order_relaxed);
+        }
+        std::memcpy(in.data(), ring.out_front(), frame_bytes);
+        ring.out_pop();
+        samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+
+    close(c.control);
+    close(c.toServer);
+    close(c.fromServer);
+    munmap(c.region, c.size);
+}
+
+// User + system CPU time of a process in microseconds, or -1 if unavailable.
+double cpu_time_us(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (pid <= 0 || !std::getline(stat, line))
+        return -1;
+    // Fields after the parenthesised command name; utime and stime are fields 14 and 15.
+    auto pos = line.rfind(')');
+    if (pos == std::string::npos)
+        return -1;
+    unsigned long long utime = 0, stime = 0;
+    if (std::sscanf(line.c_str() + pos + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        return -1;
+    return static_cast<double>(utime + stime) * 1e6 / static_cast<double>(sysconf(_SC_CLK_TCK));
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    std::string tenant;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--tenant=") == 0)
+            tenant = arg.substr(9);
+        else
+            args.push_back(arg);
+    }
+    if (args.size() < 2) {
+        std::fprintf(stderr, "Usage: %s tcp <port> | unix <path> | shm <path> [frames] [connections] [server-pid] [--tenant=ID]\n", argv[0]);
+        return 1;
+    }
+    std::string mode = args[0];
+    std::string target = args[1];
+    int frames = args.size() > 2 ? std::atoi(args[2].c_str()) : 20000;
+    int connections = args.size() > 3 ? std::atoi(args[3].c_str()) : 1;
+    int serverPid = args.size() > 4 ? std::atoi(args[4].c_str()) : 0;
+    if (frames <= 0 || connections <= 0) {
+        std::fprintf(stderr, "frames and connections must be positive\n");
+        return 1;
+    }
+    if (mode != "tcp" && mode != "unix" && mode != "shm") {
+        std::fprintf(stderr, "Unknown transport: %s\n", mode.c_str());
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    std::vector<std::vector<double>> perConnection(static_cast<std::size_t>(connections));
+    // Connect everything before the clock starts so connection setup is not measured.
+    std::vector<int> fds;
+    for (int i = 0; i < connections && mode != "shm"; ++i) {
+        fds.push_back(mode == "tcp" ? connect_tcp(std::atoi(target.c_str())) : connect_unix(target));
+        std::string identity = identity_text(tenant, fds.size());
+        if (!identity.empty()) {
+            std::string line = "APM/1 " + identity + "\n";
+            write_exact(fds.back(), line.data(), line.size());
+        }
+    }
+
+    double cpuStart = cpu_time_us(serverPid);
+    auto start = clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < perConnection.size(); ++i) {
+        perConnection[i].reserve(static_cast<std::size_t>(frames));
+        threads.emplace_back([&, i]() {
+            if (mode == "shm")
+                run_shm<clock>(target, identity_text(tenant, i + 1), frames, perConnection[i]);
+            else
+                run_stream<clock>(fds[i], frames, perConnection[i]);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    double cpuEnd = cpu_time_us(serverPid);
+
+    std::vector<double> samples;
+    for (auto& s : perConnection)
+        samples.insert(samples.end(), s.begin(), s.end());
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    double totalFrames = static_cast<double>(samples.size());
+    std::printf("%-5s conns=%d frames=%d  mean=%.1fus  p50=%.1fus  p99=%.1fus  max=%.1fus  %.0f frames/s",
+                mode.c_str(), connections, frames, sum / totalFrames,
+                percentile(samples, 0.50), percentile(samples, 0.99), samples.back(),
+                totalFrames / elapsed);
+    if (cpuStart >= 0 && cpuEnd >= 0)
+        std::printf("  server cpu=%.2fus/frame", (cpuEnd - cpuStart) / totalFrames);
+    std::printf("\n");
+    return 0;
+}